@@ -222,8 +222,13 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
         {
-          /* Read full sector directly into caller's buffer. */
-          disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+          /* Read all the full sectors wanted directly into caller's
+             buffer with one command.  A file's sectors are
+             contiguous on disk. */
+          off_t whole = size < inode_left ? size : inode_left;
+          chunk_size = whole / DISK_SECTOR_SIZE * DISK_SECTOR_SIZE;
+          disk_read_multi (filesys_disk, sector_idx,
+                           chunk_size / DISK_SECTOR_SIZE, buffer + bytes_read); 
         }
       else 
         {
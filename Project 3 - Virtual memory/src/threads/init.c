@@ -21,6 +21,7 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #ifdef VM
+#include "vm/frame.h"
 #include "vm/swap.h"
 #endif
 #ifdef USERPROG
@@ -402,4 +403,7 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+#endif
 }
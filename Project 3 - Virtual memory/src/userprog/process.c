@@ -20,6 +20,7 @@
 #include "threads/malloc.h"
 
 
+#include "vm/frame.h"
 #include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
@@ -698,7 +699,7 @@ void unmap_all(void){
   hash_first (&i, &curr->spt);
   while (hash_next(&i)){
       struct sup_page_table_entry *spte = hash_entry(hash_cur(&i), struct sup_page_table_entry, h_elem);
-      if (spte->type == MMAP){
+      if ((spte->type == MMAP || spte->type == SWAPPED) && spte->map_id != -1){
         struct unmap_struct *node = (struct unmap_struct *) malloc(sizeof(struct unmap_struct));
         node->spte = spte;
         list_push_back(&sptes, &node->elem);
@@ -709,6 +710,10 @@ void unmap_all(void){
   struct list_elem *e = list_begin(&sptes);
   while (e != list_end(&sptes)){
     temp = list_entry(e, struct unmap_struct, elem);
+    /* A mapped page that had to be evicted to swap is only up to
+       date there; bring it back so it is written to the file. */
+    if (temp->spte->type == SWAPPED)
+      load_page(temp->spte);
     if (temp->spte->loaded){
       if (pagedir_is_dirty(curr->pagedir, temp->spte->user_vaddr))
       {
@@ -717,8 +722,7 @@ void unmap_all(void){
           temp->spte->read_bytes, temp->spte->offset);
         release_filesys();
       }
-      free_frame(pagedir_get_page(curr->pagedir, temp->spte->user_vaddr));
-      pagedir_clear_page(curr->pagedir, temp->spte->user_vaddr);
+      release_frame(temp->spte);
     }
     hash_delete(&curr->spt, &temp->spte->h_elem);
     e = list_remove(e);
@@ -737,7 +741,7 @@ void unmap(int map_id){
   hash_first (&i, &curr->spt);
   while (hash_next(&i)){
       struct sup_page_table_entry *spte = hash_entry(hash_cur(&i), struct sup_page_table_entry, h_elem);
-      if (spte->type == MMAP && spte->map_id == map_id){
+      if ((spte->type == MMAP || spte->type == SWAPPED) && spte->map_id == map_id){
         struct unmap_struct *node = (struct unmap_struct *) malloc(sizeof(struct unmap_struct));
         node->map_id = map_id;
         node->spte = spte;
@@ -750,6 +754,10 @@ void unmap(int map_id){
   struct list_elem *e = list_begin(&sptes);
   while (e != list_end(&sptes)){
     temp = list_entry(e, struct unmap_struct, elem);
+    /* A mapped page that had to be evicted to swap is only up to
+       date there; bring it back so it is written to the file. */
+    if (temp->spte->type == SWAPPED)
+      load_page(temp->spte);
     if (temp->spte->loaded){
       if (pagedir_is_dirty(curr->pagedir, temp->spte->user_vaddr))
       {
@@ -758,8 +766,7 @@ void unmap(int map_id){
           temp->spte->read_bytes, temp->spte->offset);
         release_filesys();
       }
-      free_frame(pagedir_get_page(curr->pagedir, temp->spte->user_vaddr));
-      pagedir_clear_page(curr->pagedir, temp->spte->user_vaddr);
+      release_frame(temp->spte);
     }
     hash_delete(&curr->spt, &temp->spte->h_elem);
     e = list_remove(e);
@@ -20,6 +20,7 @@ static int get_free_fd(struct thread *curr);
 static int validate_addr(const void *addr, void *esp, bool to_grow);
 static int validate_string(char *str, void *esp);
 static int validate_buffer(char *buffer, int size, void *esp, bool writable);
+static void pin_buffer(char *buffer, int size, bool pin);
 void exit_process(int status);
 
 void
@@ -125,9 +126,11 @@ syscall_handler (struct intr_frame *f UNUSED)
         if (fp == NULL)
           f->eax = 0;
         else{
+          pin_buffer((char *) sys_stack[2], sys_stack[3], true);
           acquire_filesys();
           f->eax = file_read(fp, sys_stack[2], sys_stack[3]);
           release_filesys();
+          pin_buffer((char *) sys_stack[2], sys_stack[3], false);
         }
       }
       else
@@ -153,9 +156,11 @@ syscall_handler (struct intr_frame *f UNUSED)
           f->eax = 0;
         else{
           // TODO: implement write until size permits using tell and file size
+          pin_buffer(buf, size, true);
           acquire_filesys();
           f->eax = file_write(fp, buf, size);
           release_filesys();
+          pin_buffer(buf, size, false);
         }
       }
       else
@@ -355,6 +360,26 @@ static int validate_buffer(char *buffer, int size, void *esp, bool writable){
   return 0;
 }
 
+/*
+ * Pin (or unpin) every page of a buffer that validate_buffer() has
+ * accepted, so that it stays resident while a file system call copies
+ * to or from it with the file system lock held.
+ */
+static void pin_buffer(char *buffer, int size, bool pin){
+  char *page;
+  if (size <= 0)
+    return;
+  for (page = pg_round_down(buffer); page < buffer + size; page += PGSIZE){
+    struct sup_page_table_entry *spte = get_page(page);
+    if (spte == NULL)
+      continue;
+    if (!pin)
+      unpin_page(spte);
+    else if (!pin_page(spte))
+      exit_process(-1);
+  }
+}
+
 void exit_process(int status)
 { 
   struct thread *curr = thread_current();
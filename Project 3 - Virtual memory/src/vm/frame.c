@@ -1,5 +1,8 @@
+#include "devices/disk.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
-#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -7,18 +10,53 @@
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
-#include <list.h>
+#include <bitmap.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
 //#include <stdlib.h>
 //#include <time.h>
 
 static struct frame_table_entry *victim_frame(void);
+static void evict_frame(struct frame_table_entry *fte);
+static bool unmap_frame(struct frame_table_entry *fte);
+static bool swap_bound(struct frame_table_entry *fte);
+static size_t evict_cluster(struct frame_table_entry *victim);
+static void pageout_wakeup(void);
+static void pageout_daemon(void *aux);
+
+static size_t clock_hand;				// next frame the clock looks at
+static long long evict_cnt;				// frames taken from another page
+static long long swap_write_cnt;		// evicted pages written to swap
+static long long file_write_cnt;		// evicted pages written to their file
+static long long pageout_cnt;			// evictions done by the pageout thread
+
+static struct semaphore pageout_sema;	// wakes the pageout thread
+static bool pageout_pending;			// pageout_sema already raised,
+										// written under frame_table_lock
+
 /*
  * Initialize frame table
  */
 void frame_init (void){
 	//srand(time(NULL));
-	list_init(&frame_table);
+	frame_cnt = palloc_user_page_cnt();
+	frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+		DIV_ROUND_UP(frame_cnt * sizeof *frame_table, PGSIZE));
 	lock_init(&frame_table_lock);
+	sema_init(&pageout_sema, 0);
+	thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+}
+
+/*
+ * Return the frame table entry for user page FRAME, or NULL if FRAME
+ * is not a user pool page.
+ */
+struct frame_table_entry *frame_lookup(uint32_t *frame){
+	size_t idx = pg_no(frame) - pg_no(palloc_user_base());
+	if (frame == NULL || idx >= frame_cnt)
+		return NULL;
+	return &frame_table[idx];
 }
 
 
@@ -31,18 +69,17 @@ uint32_t *allocate_frame (struct sup_page_table_entry *spte, bool pal_zero){
 		flags|=PAL_ZERO;
 	
 	uint32_t *frame = (uint32_t *) palloc_get_page(flags);
+	if (frame == NULL || palloc_user_free_cnt() < PAGEOUT_LOW_WATER)
+		pageout_wakeup();
 	if (frame == NULL){
 		// PANIC("Frame couldn't be allocated\n");
-		// 
+		// The pageout thread fell behind; evict a page ourselves.
 		
 		lock_acquire(&frame_table_lock);
 		struct frame_table_entry *victim = victim_frame();
-		//if (victim->spte->type == MMAP)
-		size_t index = swap_out(victim->frame);
-		victim->spte->loaded = false;
-		victim->spte->type = SWAPPED;
-		victim->spte->index = index;
-		pagedir_clear_page(victim->owner->pagedir, victim->spte->user_vaddr);
+		if (victim == NULL)
+			PANIC("No frame to evict");
+		evict_frame(victim);
 		
 		victim->owner = thread_current();
 		victim->spte = spte;
@@ -58,35 +95,225 @@ uint32_t *allocate_frame (struct sup_page_table_entry *spte, bool pal_zero){
 }
 
 void insert_frame(uint32_t *frame, struct sup_page_table_entry *spte){
-	struct frame_table_entry *fte = malloc(sizeof(struct frame_table_entry));
+	struct frame_table_entry *fte = frame_lookup(frame);
+	ASSERT(fte != NULL);
+	
+	/* FRAME came straight from palloc, so nobody else can be using
+	   this entry; only the victim scan may look at it, and it ignores
+	   the entry until spte is set and the page is loaded.  No lock
+	   needed, which keeps faults from waiting behind a page-out. */
 	fte->frame = frame;
 	fte->owner = thread_current();
+	barrier();
 	fte->spte = spte;
-	
-	lock_acquire(&frame_table_lock);
-	list_push_back(&frame_table, &fte->elem);
-	lock_release(&frame_table_lock);
 }
 
 void free_frame(uint32_t *frame){
+	struct frame_table_entry *fte = frame_lookup(frame);
+	if (fte == NULL)
+		return;
+
 	lock_acquire(&frame_table_lock);
+	if (fte->spte != NULL){
+		fte->spte = NULL;
+		fte->owner = NULL;
+		palloc_free_page(frame);
+	}
+	lock_release(&frame_table_lock);
+}
 
-	struct frame_table_entry *temp;
-	struct list_elem *e = list_begin(&frame_table);
-	while (e != list_end(&frame_table)){
-		temp = list_entry(e, struct frame_table_entry, elem);
-		if (temp->frame == frame){
-			list_remove(e);
+/*
+ * Unmap SPTE from the current process and free its frame, if it is
+ * resident.  Holding frame_table_lock makes this atomic with respect
+ * to eviction of the same page by another thread.
+ */
+void release_frame(struct sup_page_table_entry *spte){
+	uint32_t *pd = thread_current()->pagedir;
+
+	lock_acquire(&frame_table_lock);
+	if (spte->loaded){
+		uint32_t *frame = pagedir_get_page(pd, spte->user_vaddr);
+		struct frame_table_entry *fte = frame_lookup(frame);
+		if (fte != NULL && fte->spte == spte){
+			fte->spte = NULL;
+			fte->owner = NULL;
 			palloc_free_page(frame);
-			free(temp);
-			break;
 		}
-		e = list_next(e);
+		pagedir_clear_page(pd, spte->user_vaddr);
+		spte->loaded = false;
+	}
+	lock_release(&frame_table_lock);
+}
+
+/*
+ * Remove FTE's page from its owner's page directory and return whether
+ * it was dirty.  Interrupts are off in between so that the owner can't
+ * dirty the page after the check.
+ */
+static bool unmap_frame(struct frame_table_entry *fte){
+	uint32_t *pd = fte->owner->pagedir;
+	void *upage = fte->spte->user_vaddr;
+	enum intr_level old_level;
+	bool dirty;
+
+	old_level = intr_disable();
+	dirty = pagedir_is_dirty(pd, upage);
+	pagedir_clear_page(pd, upage);
+	intr_set_level(old_level);
+	evict_cnt++;
+	return dirty;
+}
+
+/*
+ * Return true if evicting FTE's page means writing it to swap.
+ */
+static bool swap_bound(struct frame_table_entry *fte){
+	enum page_type type = fte->spte->type;
+	return type == STACK
+		|| (type == FILE
+			&& pagedir_is_dirty(fte->owner->pagedir, fte->spte->user_vaddr));
+}
+
+/*
+ * Take FTE's page away from its owner.  Clean FILE and MMAP pages are
+ * simply dropped and will be read back from their file; dirty MMAP
+ * pages are written back to their file; everything else goes to swap.
+ * The owner's mapping is removed first so that it cannot write to the
+ * page while it is being written out; SPTE stays marked loaded until
+ * the write is done, and load_page() waits on frame_table_lock if the
+ * owner faults on it meanwhile.  Caller must hold frame_table_lock.
+ */
+static void evict_frame(struct frame_table_entry *fte){
+	struct sup_page_table_entry *spte = fte->spte;
+	bool dirty = unmap_frame(fte);
+
+	if ((spte->type == FILE || spte->type == MMAP) && !dirty){
+		spte->loaded = false;
+		return;
+	}
+
+	/* Writing back needs the file system lock.  Taking it here, while
+	   holding frame_table_lock, could deadlock against a thread that
+	   faults inside a file system call, so only use it if it is free
+	   or already ours; otherwise the page goes to swap, and swap-in
+	   marks it dirty again so munmap still writes it back. */
+	if (spte->type == MMAP){
+		bool held = lock_held_by_current_thread(&filesys_lock);
+		if (held || lock_try_acquire(&filesys_lock)){
+			file_write_at(spte->file, fte->frame, spte->read_bytes, spte->offset);
+			if (!held)
+				release_filesys();
+			file_write_cnt++;
+			spte->loaded = false;
+			return;
+		}
+	}
+
+	spte->index = swap_out(fte->frame);
+	spte->type = SWAPPED;
+	spte->loaded = false;
+	swap_write_cnt++;
+}
+
+/*
+ * Ask the pageout thread to refill the free frame reserve.
+ */
+static void pageout_wakeup(void){
+	// While the flag is set the pageout thread has yet to look at the
+	// water mark, and will see the frames already taken, so there is
+	// no need to wait for the lock, which it holds while evicting
+	if (pageout_pending)
+		return;
+	lock_acquire(&frame_table_lock);
+	if (!pageout_pending){
+		pageout_pending = true;
+		sema_up(&pageout_sema);
 	}
-	
 	lock_release(&frame_table_lock);
 }
 
+/*
+ * Swap out VICTIM together with up to SWAP_CLUSTER - 1 other pages of
+ * the same process that are not recently used and would go to swap
+ * anyway, as one sequential write to consecutive swap slots.  Frees
+ * the frames and returns how many there were.  Caller must hold
+ * frame_table_lock.
+ */
+static size_t evict_cluster(struct frame_table_entry *victim){
+	struct frame_table_entry *cluster[SWAP_CLUSTER];
+	void *frames[SWAP_CLUSTER];
+	size_t cnt = 0;
+	size_t i, index;
+
+	cluster[cnt++] = victim;
+	for (i = 0; i < frame_cnt && cnt < SWAP_CLUSTER; i++){
+		struct frame_table_entry *fte = &frame_table[(clock_hand + i) % frame_cnt];
+		if (fte == victim || fte->spte == NULL || !fte->spte->loaded
+			|| fte->spte->pinned
+			|| fte->owner != victim->owner
+			|| pagedir_is_accessed(fte->owner->pagedir, fte->spte->user_vaddr)
+			|| !swap_bound(fte))
+			continue;
+		cluster[cnt++] = fte;
+	}
+
+	for (i = 0; i < cnt; i++){
+		unmap_frame(cluster[i]);
+		frames[i] = cluster[i]->frame;
+	}
+	index = swap_out_multi(frames, cnt);
+
+	for (i = 0; i < cnt; i++){
+		struct sup_page_table_entry *spte = cluster[i]->spte;
+		if (index != BITMAP_ERROR)
+			spte->index = index + i * SECTORS_PER_PAGE;
+		else
+			spte->index = swap_out(cluster[i]->frame);
+		spte->type = SWAPPED;
+		spte->loaded = false;
+		swap_write_cnt++;
+
+		cluster[i]->spte = NULL;
+		cluster[i]->owner = NULL;
+		palloc_free_page(cluster[i]->frame);
+	}
+	return cnt;
+}
+
+/*
+ * Pageout thread.  Once woken, it evicts pages until
+ * PAGEOUT_HIGH_WATER user frames are free, swapping out several pages
+ * of a process at once where it can, so that most page faults
+ * find a free frame without writing anything out themselves.
+ */
+static void pageout_daemon(void *aux UNUSED){
+	for (;;){
+		sema_down(&pageout_sema);
+		lock_acquire(&frame_table_lock);
+		while (palloc_user_free_cnt() < PAGEOUT_HIGH_WATER){
+			struct frame_table_entry *victim = victim_frame();
+			if (victim == NULL)
+				break;
+			if (swap_bound(victim))
+				pageout_cnt += evict_cluster(victim);
+			else {
+				evict_frame(victim);
+				victim->spte = NULL;
+				victim->owner = NULL;
+				palloc_free_page(victim->frame);
+				pageout_cnt++;
+			}
+			// Let faulting threads at the frame table in between
+			lock_release(&frame_table_lock);
+			lock_acquire(&frame_table_lock);
+		}
+		// Cleared in the same critical section as the last look at
+		// the water mark, so that no wakeup in between is lost
+		pageout_pending = false;
+		lock_release(&frame_table_lock);
+	}
+}
+
 static struct frame_table_entry *victim_frame(void){
 	/*
 	lock_acquire(&frame_table_lock);
@@ -117,37 +344,53 @@ static struct frame_table_entry *victim_frame(void){
 	//lock_release(&frame_table_lock);
 	*/
 
-	struct frame_table_entry *fte0 = NULL;
-	struct frame_table_entry *fte1 = NULL;
-	struct frame_table_entry *fte2 = NULL;
-	struct frame_table_entry *fte3 = NULL;
-
-	struct thread *curr = thread_current();
-	struct list_elem *e;
+	/*
+	 * Clock: sweep the hand over the frame table, checking each page in
+	 * its owner's page directory.  The first two sweeps look for a page
+	 * that is neither accessed nor dirty, the second one clearing
+	 * accessed bits as it goes; the last two accept dirty pages too.
+	 * Frames whose page is still being loaded or is pinned are skipped.
+	 */
 	struct frame_table_entry *fte;
-	for (e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)){
-		fte = list_entry(e, struct frame_table_entry, elem);
-		if (pagedir_is_accessed(curr->pagedir, fte->spte->user_vaddr)
-			&& pagedir_is_dirty(curr->pagedir, fte->spte->user_vaddr)
-			&& fte3 == NULL)
-			fte3 = fte;
-		else if (pagedir_is_accessed(curr->pagedir, fte->spte->user_vaddr)
-			&& (!pagedir_is_dirty(curr->pagedir, fte->spte->user_vaddr))
-			&& fte2 == NULL)
-			fte2 = fte;
-		else if ((!pagedir_is_accessed(curr->pagedir, fte->spte->user_vaddr))
-			&& pagedir_is_dirty(curr->pagedir, fte->spte->user_vaddr)
-			&& fte1 == NULL)
-			fte1 = fte;
-		else if (fte0 == NULL)
-			fte0 = fte;
+	int pass;
+	size_t i;
+	for (pass = 0; pass < 4; pass++){
+		for (i = 0; i < frame_cnt; i++){
+			fte = &frame_table[clock_hand];
+			clock_hand = (clock_hand + 1) % frame_cnt;
+			if (fte->spte == NULL || !fte->spte->loaded || fte->spte->pinned
+				|| fte->owner->pagedir == NULL)
+				continue;
+
+			uint32_t *pd = fte->owner->pagedir;
+			void *upage = fte->spte->user_vaddr;
+			if (pagedir_is_accessed(pd, upage)){
+				if (pass % 2 == 1)
+					pagedir_set_accessed(pd, upage, false);
+				continue;
+			}
+			if (pass >= 2 || !pagedir_is_dirty(pd, upage))
+				return fte;
+		}
+	}
+
+	/* Every resident page was touched again during the sweeps; take
+	   whatever loaded, unpinned page the hand points at. */
+	for (i = 0; i < frame_cnt; i++){
+		fte = &frame_table[clock_hand];
+		clock_hand = (clock_hand + 1) % frame_cnt;
+		if (fte->spte != NULL && fte->spte->loaded && !fte->spte->pinned
+			&& fte->owner->pagedir != NULL)
+			return fte;
 	}
+	return NULL;
+}
 
-	if (fte0 != NULL)
-		return fte0;
-	else if (fte1 != NULL)
-		return fte1;
-	else if (fte2 != NULL)
-		return fte2;
-	return fte3;
-}
\ No newline at end of file
+/*
+ * Print eviction statistics.
+ */
+void frame_print_stats (void){
+	printf("Frame: %lld evictions (%lld by pageout), %lld swap writes, "
+		"%lld file writes\n",
+		evict_cnt, pageout_cnt, swap_write_cnt, file_write_cnt);
+}
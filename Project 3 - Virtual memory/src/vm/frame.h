@@ -1,24 +1,32 @@
 #include <stdbool.h>
 #include "threads/synch.h"
 #include "vm/page.h"
-#include <list.h>
+#include <stddef.h>
 
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
-struct list frame_table;			// frame table itself
-struct lock frame_table_lock;		// lock for using frame table
+/* One entry per user pool page, indexed by the page's offset from
+   palloc_user_base().  spte is NULL while the page is free. */
+#define PAGEOUT_LOW_WATER 16		// wake the pageout thread below this
+#define PAGEOUT_HIGH_WATER 64		// pageout thread stops at this
 
 struct frame_table_entry
 {
 	uint32_t* frame;
 	struct thread* owner;
 	struct sup_page_table_entry* spte;
-	struct list_elem elem;
 };
 
+struct frame_table_entry *frame_table;	// frame table itself
+size_t frame_cnt;					// number of entries in frame_table
+struct lock frame_table_lock;		// lock for using frame table
+
 void frame_init(void);
 uint32_t *allocate_frame (struct sup_page_table_entry *spte, bool pal_zero);
 void insert_frame(uint32_t *frame, struct sup_page_table_entry *spte);
 void free_frame(uint32_t *frame);
+void release_frame(struct sup_page_table_entry *spte);
+struct frame_table_entry *frame_lookup(uint32_t *frame);
+void frame_print_stats(void);
 #endif /* vm/frame.h */
@@ -17,6 +17,7 @@ static bool load_page_file(struct sup_page_table_entry *spte);
 static bool load_page_stack(struct sup_page_table_entry *spte);
 static bool load_page_swap(struct sup_page_table_entry *spte);
 static bool load_page_mmap(struct sup_page_table_entry *spte);
+static void set_loaded(struct sup_page_table_entry *spte);
 
 /*
  * Initialize supplementary page table
@@ -44,6 +45,7 @@ allocate_page_file(void *addr, struct file *f, bool read_only,
 	spte->map_id = -1;
 	spte->read_only = read_only;
 	spte->loaded = false;
+	spte->pinned = false;
 	spte->file = f;
 	spte->offset = ofs;
 	spte->read_bytes = read_bytes;
@@ -66,6 +68,7 @@ allocate_page_mmap(void *addr, struct file *f, int map_id,
 	spte->map_id = map_id;
 	spte->read_only = false;
 	spte->loaded = false;
+	spte->pinned = false;
 	spte->file = f;
 	spte->offset = ofs;
 	spte->read_bytes = read_bytes;
@@ -80,8 +83,11 @@ allocate_page_stack(void *addr){
 	    return NULL;
 	spte->user_vaddr = pg_round_down(addr);
 	spte->type = STACK;
+	spte->map_id = -1;
 	spte->read_only = false;
 	spte->loaded = false;
+	spte->pinned = false;
+	spte->file = NULL;
 	return spte;
 }
 
@@ -96,8 +102,15 @@ struct sup_page_table_entry *get_page(void *user_vaddr){
 }
 
 bool load_page(struct sup_page_table_entry *spte){
-  	if (spte->loaded)
-  		return true;
+  	if (spte->loaded){
+  		// The page may be in the middle of being evicted; wait for that
+  		// to finish and load it again if it did go.
+  		lock_acquire(&frame_table_lock);
+  		bool loaded = spte->loaded;
+  		lock_release(&frame_table_lock);
+  		if (loaded)
+  			return true;
+  	}
   	switch (spte->type){
     	case FILE:
       		return load_page_file(spte);
@@ -123,9 +136,13 @@ static bool load_page_file(struct sup_page_table_entry *spte){
 	
 	if (spte->read_bytes > 0)
     {
-      acquire_filesys();
+      // A kernel fault inside a file system call already holds the lock
+      bool held = lock_held_by_current_thread(&filesys_lock);
+      if (!held)
+        acquire_filesys();
       off_t actual_read = file_read_at(spte->file, frame, spte->read_bytes, spte->offset);
-      release_filesys();
+      if (!held)
+        release_filesys();
       //printf("actual_read and read_bytes: %d and %d\n", actual_read, spte->read_bytes);
       if (actual_read != spte->read_bytes){
       	free_frame(frame);
@@ -139,7 +156,7 @@ static bool load_page_file(struct sup_page_table_entry *spte){
     	free_frame(frame);
     	return false;
     }
-    spte->loaded = true;
+    set_loaded(spte);
     return true;
 }
 
@@ -154,9 +171,13 @@ static bool load_page_mmap(struct sup_page_table_entry *spte){
 	
 	if (spte->read_bytes > 0)
     {
-      acquire_filesys();
+      // A kernel fault inside a file system call already holds the lock
+      bool held = lock_held_by_current_thread(&filesys_lock);
+      if (!held)
+        acquire_filesys();
       off_t actual_read = file_read_at(spte->file, frame, spte->read_bytes, spte->offset);
-      release_filesys();
+      if (!held)
+        release_filesys();
       //printf("actual_read and read_bytes: %d and %d\n", actual_read, spte->read_bytes);
       if (actual_read != spte->read_bytes){
       	free_frame(frame);
@@ -170,7 +191,7 @@ static bool load_page_mmap(struct sup_page_table_entry *spte){
     	free_frame(frame);
     	return false;
     }
-    spte->loaded = true;
+    set_loaded(spte);
     return true;
 }
 
@@ -193,7 +214,7 @@ static bool load_page_stack(struct sup_page_table_entry *spte){
     	free_frame(frame);
     	return false;
     }
-	spte->loaded = true;
+	set_loaded(spte);
 	return true;
 }
 
@@ -210,16 +231,45 @@ static bool load_page_swap(struct sup_page_table_entry *spte){
     	free_frame(frame);
     	return false;
     }
+    // The only copy is in memory now; never drop it on eviction.
+    pagedir_set_dirty(thread_current()->pagedir, spte->user_vaddr, true);
     if(spte->file != NULL && spte->map_id == -1)
     	spte->type = FILE;
     else if (spte->file != NULL)
     	spte->type = MMAP;
     else
     	spte->type = STACK;
-	spte->loaded = true;
+	set_loaded(spte);
 	return true;
 }
 
+/*
+ * Mark SPTE resident.  The page starts out accessed, so that the clock
+ * passes over it at least once instead of evicting it before the
+ * faulting instruction has even been retried.
+ */
+static void set_loaded(struct sup_page_table_entry *spte){
+	pagedir_set_accessed(thread_current()->pagedir, spte->user_vaddr, true);
+	spte->loaded = true;
+}
+
+/*
+ * Keep SPTE's page resident until unpin_page(), loading it if needed,
+ * so that a system call can use it while holding the file system
+ * lock.  Returns false if the page could not be loaded.
+ */
+bool pin_page(struct sup_page_table_entry *spte){
+	// Under the lock, so that an eviction already under way finishes
+	lock_acquire(&frame_table_lock);
+	spte->pinned = true;
+	lock_release(&frame_table_lock);
+	return load_page(spte);
+}
+
+void unpin_page(struct sup_page_table_entry *spte){
+	spte->pinned = false;
+}
+
 void destroy_spt(struct hash *spt){
  	hash_destroy(spt, action_func);
 }
@@ -240,9 +290,6 @@ static bool less_func(const struct hash_elem *e1, const struct hash_elem *e2, vo
 static void action_func(struct hash_elem *e, void *aux UNUSED)
 {
  	struct sup_page_table_entry *spte = hash_entry(e, struct sup_page_table_entry, h_elem);
- 	if (spte->loaded){
-		free_frame(pagedir_get_page(thread_current()->pagedir, spte->user_vaddr));
-		pagedir_clear_page(thread_current()->pagedir, spte->user_vaddr);
- 	}
+	release_frame(spte);
   	free(spte);
 }
\ No newline at end of file
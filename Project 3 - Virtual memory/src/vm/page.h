@@ -23,6 +23,7 @@ struct sup_page_table_entry
 	bool loaded;					// true if loaded to memory
 	bool dirty;
 	bool accessed;
+	bool pinned;					// true if it must not be evicted
 
 	// for files
 	struct file *file;
@@ -51,6 +52,8 @@ allocate_page_stack(void *addr);
 
 struct sup_page_table_entry *get_page(void *user_vaddr);
 bool load_page(struct sup_page_table_entry *spte);
+bool pin_page(struct sup_page_table_entry *spte);
+void unpin_page(struct sup_page_table_entry *spte);
 void destroy_spt(struct hash *spt);
 
 #endif /* vm/page.h */
@@ -39,10 +39,9 @@ swap_in(size_t index, void *frame)
 	size_t i;
 
 	lock_acquire(&swap_lock);
-	for (i = 0; i < SECTORS_PER_PAGE; i++){
+	for (i = 0; i < SECTORS_PER_PAGE; i++)
 		bitmap_flip(swap_table, index+i);
-		disk_read(swap_device, index + i, (char *) frame + i*DISK_SECTOR_SIZE);
-	}
+	disk_read_multi(swap_device, index, SECTORS_PER_PAGE, frame);
 	lock_release(&swap_lock);
 }
 
@@ -64,7 +63,7 @@ size_t
 swap_out (void *frame)
 {
 	lock_acquire(&swap_lock);
-	size_t free_index = bitmap_scan_and_flip(swap_table, 0, SECTORS_PER_PAGE, false);
+	size_t free_index = bitmap_scan_and_flip_next(swap_table, SECTORS_PER_PAGE, false);
 	
   	if (free_index == BITMAP_ERROR){
   		lock_release(&swap_lock);
@@ -72,9 +71,31 @@ swap_out (void *frame)
     	return free_index;
   	}
   	
-  	size_t i;
-  	for (i = 0; i < SECTORS_PER_PAGE; i++)
-      	disk_write(swap_device, free_index + i, (char *) frame + i*DISK_SECTOR_SIZE);
+  	disk_write_multi(swap_device, free_index, SECTORS_PER_PAGE, frame);
 	lock_release(&swap_lock);
   	return free_index;
 }
+
+/*
+ * Evict CNT frames to consecutive swap slots with a single sequential
+ * write, taken straight from the frames themselves, so that pages
+ * evicted together are also read back from neighbouring sectors.
+ * Frame i goes to the returned index plus i * SECTORS_PER_PAGE.
+ * Returns BITMAP_ERROR, writing nothing, if no run of CNT free slots
+ * is left.
+ */
+size_t
+swap_out_multi (void **frames, size_t cnt)
+{
+	ASSERT (cnt <= SWAP_CLUSTER);
+	lock_acquire(&swap_lock);
+	size_t free_index = bitmap_scan_and_flip_next(swap_table,
+		cnt * SECTORS_PER_PAGE, false);
+	if (free_index == BITMAP_ERROR){
+		lock_release(&swap_lock);
+		return free_index;
+	}
+	disk_write_gather(swap_device, free_index, frames, cnt, SECTORS_PER_PAGE);
+	lock_release(&swap_lock);
+	return free_index;
+}
@@ -13,9 +13,11 @@ static struct bitmap *swap_table;
 static struct lock swap_lock;
 
 #define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE) // 8
+#define SWAP_CLUSTER 16			// most pages written by one swap_out_multi
 
 void swap_init (void);
 void swap_in(size_t index, void *frame);
 size_t swap_out (void *frame);
+size_t swap_out_multi (void **frames, size_t cnt);
 
 #endif /* vm/swap.h */
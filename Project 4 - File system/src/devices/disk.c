@@ -32,6 +32,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +48,12 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors a single command can transfer. */
+#define MAX_TRANSFER 256
 
 /* An ATA device. */
 struct disk 
@@ -57,6 +64,8 @@ struct disk
 
     bool is_ata;                /* 1=This device is an ATA disk. */
     disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+    size_t multiple;            /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, 0 if those are not used. */
 
     long long read_cnt;         /* Number of sectors read. */
     long long write_cnt;        /* Number of sectors written. */
@@ -86,10 +95,11 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void set_multiple_mode (struct disk *, uint8_t cnt);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -138,6 +148,7 @@ disk_init (void)
 
           d->is_ata = false;
           d->capacity = 0;
+          d->multiple = 0;
 
           d->read_cnt = d->write_cnt = 0;
         }
@@ -219,48 +230,111 @@ disk_size (struct disk *d)
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) 
 {
+  disk_read_multi (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+{
+  disk_write_multi (d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Each command transfers up to MAX_TRANSFER sectors, and
+   raises one interrupt per block of D->multiple sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                 void *buffer_) 
+{
+  uint8_t *buffer = buffer_;
+  size_t block;
   struct channel *c;
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
   c = d->channel;
+  block = d->multiple > 0 ? d->multiple : 1;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  d->read_cnt++;
+  while (cnt > 0) 
+    {
+      size_t n = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+      size_t i;
+
+      select_sectors (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_READ_MULTIPLE
+                                            : CMD_READ_SECTOR_RETRY);
+      for (i = 0; i < n; i += block) 
+        {
+          size_t k = n - i < block ? n - i : block;
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          input_sectors (c, buffer, k);
+          buffer += k * DISK_SECTOR_SIZE;
+        }
+      d->read_cnt += n;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT consecutive sectors starting at SEC_NO on disk
+   D from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer)
+disk_write_multi (struct disk *d, disk_sector_t sec_no, size_t cnt,
+                  const void *buffer_)
 {
+  const uint8_t *buffer = buffer_;
+  size_t block;
   struct channel *c;
   
   ASSERT (d != NULL);
   ASSERT (buffer != NULL);
 
   c = d->channel;
+  block = d->multiple > 0 ? d->multiple : 1;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  d->write_cnt++;
+  while (cnt > 0) 
+    {
+      size_t n = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+      size_t i;
+
+      select_sectors (d, sec_no, n);
+      issue_pio_command (c, d->multiple > 0 ? CMD_WRITE_MULTIPLE
+                                            : CMD_WRITE_SECTOR_RETRY);
+      /* The disk interrupts after taking each block, the last
+         time once all of them are written. */
+      for (i = 0; i < n; i += block) 
+        {
+          size_t k = n - i < block ? n - i : block;
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+          output_sectors (c, buffer, k);
+          buffer += k * DISK_SECTOR_SIZE;
+          sema_down (&c->completion_wait);
+        }
+      d->write_cnt += n;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -381,11 +455,16 @@ identify_ata_device (struct disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity. */
   d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+  /* Word 47 gives the most sectors READ/WRITE MULTIPLE can move
+     per interrupt, 0 if the disk does not support them. */
+  if ((id[47] & 0xff) != 0)
+    set_multiple_mode (d, id[47] & 0xff);
+
   /* Print identification message. */
   printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
   if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -425,19 +504,39 @@ print_ata_string (char *string, size_t size)
     printf ("%c", string[i ^ 1]);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D so that READ and
+   WRITE MULTIPLE transfer CNT sectors per interrupt.  Leaves
+   D->multiple at 0, so that those commands are not used, if the
+   disk rejects it. */
+static void
+set_multiple_mode (struct disk *d, uint8_t cnt) 
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_alt_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, at most MAX_TRANSFER, to the disk's
+   sector selection and count registers.  (We use LBA mode.) */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) 
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) 
 {
   struct channel *c = d->channel;
 
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER);
   ASSERT (sec_no < d->capacity);
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt <= d->capacity - sec_no);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_TRANSFER ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -458,20 +557,21 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for DISK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain DISK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * DISK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
@@ -1,68 +1,380 @@
 
 
+#include <debug.h>
 #include "devices/disk.h"
 #include "devices/timer.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/malloc.h"
 #include "filesys/cache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include <list.h>
+#include <hash.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-static struct cache_entry *victim_sector();
+enum cache_policy cache_policy = CACHE_CLOCK;
+
+// Sector number -> cache entry, so that lookups do not walk buffer_cache
+static struct hash buffer_cache_map;
+
+// Clock: next entry of buffer_cache to be examined
+static struct list_elem *clock_hand;
+
+// 2Q: entries touched only once so far, oldest first. Entries that
+// are touched again move to buffer_cache, which is kept in LRU order.
+static struct list a1_queue;
+static size_t a1_size;
+#define A1_MAX (CACHE_SIZE / 4)
+
+// Write-behind: the flusher thread writes dirty entries back every
+// FLUSH_INTERVAL ticks, or sooner once DIRTY_HIGH entries are dirty.
+#define FLUSH_INTERVAL TIMER_FREQ
+#define FLUSH_POLL (TIMER_FREQ / 20)
+#define DIRTY_HIGH (CACHE_SIZE / 2)
+
+static size_t dirty_cnt;
+static size_t flushing_cnt;			// entries whose write-back is in flight
+static size_t pinned_cnt;			// entries with a nonzero pin count
+static bool cache_closing;			// set by free_cache(), stops the flusher
+static struct condition entry_freed;	// signaled when entries stop being
+										// written back or get unpinned
+static uint8_t *flush_buf;			// snapshot of the payloads being written
+
+// Read-ahead: sectors queued by cache_read_ahead() and brought in by
+// the readahead thread before their readers ask for them. Runs of up
+// to RA_BATCH consecutive sectors are read with a single command.
+#define RA_QUEUE_SIZE 64
+#define RA_BATCH 16
+
+static disk_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head;
+static size_t ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_nonempty;
+
+static long long cache_hit_cnt;
+static long long cache_miss_cnt;
+static unsigned write_back_gen;		// bumped after each write-back, so that
+									// read-ahead can tell its data is stale
+
+static struct cache_entry *cache_load(disk_sector_t sector_num, bool fill, bool *locked);
+static struct cache_entry *cache_pin(disk_sector_t sector_num, bool fill, bool *locked);
+static void cache_unpin(struct cache_entry *entry);
+static void unpin(struct cache_entry *entry);
+static void write_back(struct cache_entry *entry);
+static bool evictable(const struct cache_entry *entry);
+static void read_ahead_worker(void *aux UNUSED);
+static void cache_touch(struct cache_entry *entry);
+static void set_dirty_flag(struct cache_entry *entry, bool dirty);
+static void flusher(void *aux UNUSED);
+static void cache_flush(void);
+static int sector_less(const void *a, const void *b);
+static struct cache_entry *first_evictable(struct list *list);
+static struct cache_entry *victim_sector(void);
+static struct cache_entry *victim_clock(void);
+static struct cache_entry *victim_2q(void);
+static struct cache_entry *cache_lookup(disk_sector_t sector_num);
+static unsigned hash_func(const struct hash_elem *e, void *aux UNUSED);
+static bool less_func(const struct hash_elem *e1, const struct hash_elem *e2, void *aux UNUSED);
 
 void buffer_cache_init(){
 	list_init(&buffer_cache);
+	list_init(&a1_queue);
 	lock_init(&buffer_cache_lock);
+	hash_init(&buffer_cache_map, hash_func, less_func, NULL);
 	buffer_cache_size = 0;
+	a1_size = 0;
+	clock_hand = NULL;
+	dirty_cnt = 0;
+	flushing_cnt = 0;
+	pinned_cnt = 0;
+	cache_closing = false;
+	cond_init(&entry_freed);
+	flush_buf = malloc(CACHE_SIZE * DISK_SECTOR_SIZE);
+	if (flush_buf == NULL)
+		PANIC("buffer cache: cannot allocate flush buffer");
+	thread_create("flusher", PRI_DEFAULT, flusher, NULL);
+
+	ra_head = 0;
+	ra_cnt = 0;
+	lock_init(&ra_lock);
+	cond_init(&ra_nonempty);
+	thread_create("readahead", PRI_DEFAULT, read_ahead_worker, NULL);
 }
 
-struct cache_entry *cache_get_sector(disk_sector_t sector_num, bool set_dirty){
-	struct cache_entry *ans;
-	struct list_elem *e;
-	//printf("get_sector: sector is %d \n", sector_num);
-	for (e = list_begin(&buffer_cache); e != list_end(&buffer_cache); e = list_next(e)){
-		ans = list_entry(e, struct cache_entry, elem);
-		if (ans->sector_num == sector_num){
-			ans->accessed = true;
-			ans->access_time = timer_ticks();
-			ans->dirty|=set_dirty;
-			return ans;
+// Selects replacement policy by NAME ("clock", "lru" or "2q").
+// Must be called before buffer_cache_init().
+bool cache_set_policy(const char *name){
+	if (name == NULL)
+		return false;
+	if (!strcmp(name, "clock"))
+		cache_policy = CACHE_CLOCK;
+	else if (!strcmp(name, "lru"))
+		cache_policy = CACHE_LRU;
+	else if (!strcmp(name, "2q"))
+		cache_policy = CACHE_2Q;
+	else
+		return false;
+	return true;
+}
+
+// Pins the entry caching SECTOR_NUM, reading the sector in if needed,
+// and locks it for reading or, if EXCLUSIVE, for writing. A pinned entry
+// is never replaced or written back, so the caller may use its payload
+// until cache_release(). Writers call cache_mark_dirty() before that.
+struct cache_entry *cache_acquire(disk_sector_t sector_num, bool exclusive){
+	struct cache_entry *entry = cache_pin(sector_num, true, NULL);
+	if (exclusive)
+		rwlock_acquire_write(&entry->rwlock);
+	else
+		rwlock_acquire_read(&entry->rwlock);
+	return entry;
+}
+
+// Unlocks and unpins ENTRY, acquired with the same EXCLUSIVE
+void cache_release(struct cache_entry *entry, bool exclusive){
+	if (exclusive)
+		rwlock_release_write(&entry->rwlock);
+	else
+		rwlock_release_read(&entry->rwlock);
+	cache_unpin(entry);
+}
+
+// Copies SIZE bytes at offset OFS of sector SECTOR_NUM into BUFFER
+void cache_read(disk_sector_t sector_num, void *buffer, size_t ofs, size_t size){
+	ASSERT(ofs + size <= DISK_SECTOR_SIZE);
+	struct cache_entry *entry = cache_acquire(sector_num, false);
+	memcpy(buffer, entry->payload + ofs, size);
+	cache_release(entry, false);
+}
+
+// Copies SIZE bytes from BUFFER to offset OFS of sector SECTOR_NUM.
+// A write covering the whole sector does not read it from disk first.
+void cache_write(disk_sector_t sector_num, const void *buffer, size_t ofs, size_t size){
+	ASSERT(ofs + size <= DISK_SECTOR_SIZE);
+	bool locked;
+	struct cache_entry *entry = cache_pin(sector_num, size < DISK_SECTOR_SIZE, &locked);
+	if (!locked)
+		rwlock_acquire_write(&entry->rwlock);
+	memcpy(entry->payload + ofs, buffer, size);
+	cache_mark_dirty(entry);
+	cache_release(entry, true);
+}
+
+// Like cache_write(), for a sector that holds no data yet: it is never
+// read from disk, and every byte outside the written range becomes zero.
+void cache_write_new(disk_sector_t sector_num, const void *buffer, size_t ofs, size_t size){
+	ASSERT(ofs + size <= DISK_SECTOR_SIZE);
+	bool locked;
+	struct cache_entry *entry = cache_pin(sector_num, false, &locked);
+	if (!locked)
+		rwlock_acquire_write(&entry->rwlock);
+	memset(entry->payload, 0, DISK_SECTOR_SIZE);
+	if (size > 0)
+		memcpy(entry->payload + ofs, buffer, size);
+	cache_mark_dirty(entry);
+	cache_release(entry, true);
+}
+
+// Drops SECTOR_NUM from the cache without writing it back. Called when
+// the sector is freed, so that stale contents can neither be written
+// over its next owner nor be read back by it. A write-back in flight
+// is waited for, as the entry cannot be dropped before it ends.
+void cache_invalidate(disk_sector_t sector_num){
+	struct cache_entry *entry;
+	lock_acquire(&buffer_cache_lock);
+	while ((entry = cache_lookup(sector_num)) != NULL && entry->flushing)
+		cond_wait(&entry_freed, &buffer_cache_lock);
+	if (entry != NULL){
+		hash_delete(&buffer_cache_map, &entry->h_elem);
+		set_dirty_flag(entry, false);
+		entry->accessed = false;
+		entry->sector_num = CACHE_NO_SECTOR;
+		// Make it the next victim under LRU and 2Q as well
+		if (cache_policy != CACHE_CLOCK){
+			list_remove(&entry->elem);
+			list_push_front(entry->in_a1 ? &a1_queue : &buffer_cache, &entry->elem);
 		}
 	}
-	return NULL;
+	lock_release(&buffer_cache_lock);
 }
 
-struct cache_entry *cache_fetch_sector(disk_sector_t sector_num, bool set_dirty){
-	lock_acquire(&buffer_cache_lock);
+// Returns the entry for SECTOR_NUM pinned, reading it from disk into a
+// free or replaced entry if it is not cached. If FILL is false the
+// caller overwrites the whole sector, so the entry is zeroed instead of
+// read, and handed over locked for writing, with *LOCKED set, before
+// anyone else can see the zeroes; *LOCKED is cleared for a cached
+// entry, which the caller locks itself. LOCKED may be null if FILL is
+// true. buffer_cache_lock must be held; it is dropped while the sector
+// is read, with the entry locked so that its other users wait.
+static struct cache_entry *cache_load(disk_sector_t sector_num, bool fill, bool *locked){
 	//printf("fetch_sector: sector is %d \n", sector_num);
 	struct cache_entry *entry;
-	if (buffer_cache_size < 64){
+	struct cache_entry *victim = NULL;
+	for (;;){
+		entry = cache_lookup(sector_num);
+		if (entry != NULL){
+			cache_hit_cnt++;
+			cache_touch(entry);
+			if (entry->pin_cnt++ == 0)
+				pinned_cnt++;
+			if (locked != NULL)
+				*locked = false;
+			return entry;
+		}
+		if (buffer_cache_size < CACHE_SIZE)
+			break;
+		// Pinned entries and those being written back cannot be replaced
+		victim = victim_sector();
+		if (victim == NULL){
+			cond_wait(&entry_freed, &buffer_cache_lock);
+			continue;
+		}
+		if (victim->dirty){
+			// Written back without buffer_cache_lock, so meanwhile others
+			// may have pinned or redirtied it, or brought the sector in
+			write_back(victim);
+			if (cache_lookup(sector_num) != NULL || !evictable(victim) || victim->dirty)
+				continue;
+		}
+		break;
+	}
+	cache_miss_cnt++;
+
+	bool reused = false;
+	if (victim == NULL){
 		//printf("fetch_sector: cache size is less than 64\n");
 		entry = (struct cache_entry *) malloc(sizeof(struct cache_entry));
-		if (entry == NULL){
-			printf("fetch_sector: malloc returned NULL\n");
-			return NULL;
-		}
-		list_push_back(&buffer_cache, &entry->elem);
+		if (entry == NULL)
+			PANIC("buffer cache: cannot allocate entry");
+		rwlock_init(&entry->rwlock);
 		buffer_cache_size++;
 	}
 	else{
-		entry = victim_sector();
-		if (entry->dirty)
-			disk_write(filesys_disk, entry->sector_num, entry->payload);
+		entry = victim;
+		reused = true;
+		if (entry->sector_num != CACHE_NO_SECTOR)
+			hash_delete(&buffer_cache_map, &entry->h_elem);
+		if (cache_policy != CACHE_CLOCK){
+			list_remove(&entry->elem);
+			if (entry->in_a1)
+				a1_size--;
+		}
+	}
+
+	// New entries sit where the policy expects them: in place behind the
+	// clock hand, at the MRU end for LRU, at the tail of A1 for 2Q
+	if (cache_policy == CACHE_2Q){
+		list_push_back(&a1_queue, &entry->elem);
+		entry->in_a1 = true;
+		a1_size++;
+	}
+	else{
+		if (!reused || cache_policy == CACHE_LRU)
+			list_push_back(&buffer_cache, &entry->elem);
+		entry->in_a1 = false;
 	}
 	entry->accessed = true;
-	entry->dirty = set_dirty;
-	entry->access_time = timer_ticks();
+	entry->dirty = false;
+	entry->flushing = false;
+	entry->pin_cnt = 1;
+	pinned_cnt++;
 	entry->sector_num = sector_num;
-	disk_read(filesys_disk, sector_num, entry->payload);
+	hash_insert(&buffer_cache_map, &entry->h_elem);
+	// Nobody else holds an entry that was not pinned
+	rwlock_acquire_write(&entry->rwlock);
+	if (fill){
+		lock_release(&buffer_cache_lock);
+		disk_read(filesys_disk, sector_num, entry->payload);
+		rwlock_release_write(&entry->rwlock);
+		lock_acquire(&buffer_cache_lock);
+		if (locked != NULL)
+			*locked = false;
+	}
+	else{
+		ASSERT(locked != NULL);
+		memset(entry->payload, 0, DISK_SECTOR_SIZE);
+		*locked = true;
+	}
+	return entry;
+}
 
+// cache_load() for callers not holding buffer_cache_lock
+static struct cache_entry *cache_pin(disk_sector_t sector_num, bool fill, bool *locked){
+	lock_acquire(&buffer_cache_lock);
+	struct cache_entry *entry = cache_load(sector_num, fill, locked);
 	lock_release(&buffer_cache_lock);
 	return entry;
 }
 
+// Drops a pin taken by cache_load()
+static void cache_unpin(struct cache_entry *entry){
+	lock_acquire(&buffer_cache_lock);
+	unpin(entry);
+	lock_release(&buffer_cache_lock);
+}
+
+// cache_unpin() with buffer_cache_lock held
+static void unpin(struct cache_entry *entry){
+	ASSERT(entry->pin_cnt > 0);
+	if (--entry->pin_cnt == 0){
+		pinned_cnt--;
+		cond_broadcast(&entry_freed, &buffer_cache_lock);
+	}
+}
+
+// Writes unpinned, dirty ENTRY back to disk. buffer_cache_lock must be
+// held; it is dropped during the write, while ENTRY is kept cached and
+// unevictable and its payload is held still by a read lock, so that
+// neither hits nor misses on other sectors wait for the disk.
+static void write_back(struct cache_entry *entry){
+	ASSERT(entry->pin_cnt == 0 && !entry->flushing);
+	set_dirty_flag(entry, false);
+	entry->flushing = true;
+	flushing_cnt++;
+	// Unpinned, so nobody holds or waits for the lock
+	rwlock_acquire_read(&entry->rwlock);
+	lock_release(&buffer_cache_lock);
+	disk_write(filesys_disk, entry->sector_num, entry->payload);
+	rwlock_release_read(&entry->rwlock);
+	lock_acquire(&buffer_cache_lock);
+	entry->flushing = false;
+	flushing_cnt--;
+	write_back_gen++;
+	cond_broadcast(&entry_freed, &buffer_cache_lock);
+}
+
+// Asks the readahead thread to bring SECTOR_NUM into the cache.
+// Dropped if the queue is full; read-ahead is only a hint.
+void cache_read_ahead(disk_sector_t sector_num){
+	lock_acquire(&ra_lock);
+	if (ra_cnt < RA_QUEUE_SIZE){
+		ra_queue[(ra_head + ra_cnt) % RA_QUEUE_SIZE] = sector_num;
+		ra_cnt++;
+		cond_signal(&ra_nonempty, &ra_lock);
+	}
+	lock_release(&ra_lock);
+}
+
+// Marks ENTRY as modified. Writers call this after they are done
+// copying into the payload, so that a concurrent write-back cannot
+// clean the entry before the new data is in it.
+void cache_mark_dirty(struct cache_entry *entry){
+	lock_acquire(&buffer_cache_lock);
+	set_dirty_flag(entry, true);
+	lock_release(&buffer_cache_lock);
+}
+
 void free_cache(){
 	lock_acquire(&buffer_cache_lock);
+	cache_closing = true;
+	while (flushing_cnt > 0 || pinned_cnt > 0)
+		cond_wait(&entry_freed, &buffer_cache_lock);
+	hash_clear(&buffer_cache_map, NULL);
+	list_splice(list_end(&buffer_cache), list_begin(&a1_queue), list_end(&a1_queue));
 	struct cache_entry *temp;
 	struct list_elem *e = list_begin(&buffer_cache);
 	struct list_elem *next;
@@ -76,26 +388,281 @@ void free_cache(){
 		free(temp);
 		e = next;
 	}
+	buffer_cache_size = 0;
+	a1_size = 0;
+	dirty_cnt = 0;
+	clock_hand = NULL;
 	lock_release(&buffer_cache_lock);
 }
 
-// First unaccessed entry in cache (if exists) or 
-// least recently accessed entry
-static struct cache_entry *victim_sector(){
-	struct cache_entry *ans;
-	struct cache_entry *temp;
+void cache_print_stats(void){
+	printf("Buffer cache: %lld hits, %lld misses\n", cache_hit_cnt, cache_miss_cnt);
+}
+
+// Records a hit on ENTRY; buffer_cache_lock must be held
+static void cache_touch(struct cache_entry *entry){
+	entry->accessed = true;
+	if (cache_policy == CACHE_LRU || cache_policy == CACHE_2Q){
+		list_remove(&entry->elem);
+		list_push_back(&buffer_cache, &entry->elem);
+		if (entry->in_a1){
+			entry->in_a1 = false;
+			a1_size--;
+		}
+	}
+}
+
+// Sets ENTRY's dirty bit, keeping dirty_cnt in sync;
+// buffer_cache_lock must be held
+static void set_dirty_flag(struct cache_entry *entry, bool dirty){
+	// An invalidated entry has nowhere to be written back to
+	if (dirty && entry->sector_num == CACHE_NO_SECTOR)
+		return;
+	if (entry->dirty != dirty){
+		if (dirty)
+			dirty_cnt++;
+		else
+			dirty_cnt--;
+	}
+	entry->dirty = dirty;
+}
+
+// Read-ahead thread body
+static void read_ahead_worker(void *aux UNUSED){
+	static uint8_t ra_buf[RA_BATCH * DISK_SECTOR_SIZE];
+	for (;;){
+		lock_acquire(&ra_lock);
+		while (ra_cnt == 0)
+			cond_wait(&ra_nonempty, &ra_lock);
+		disk_sector_t first = ra_queue[ra_head];
+		size_t cnt = 1;
+		while (cnt < ra_cnt && cnt < RA_BATCH
+		       && ra_queue[(ra_head + cnt) % RA_QUEUE_SIZE] == first + cnt)
+			cnt++;
+		ra_head = (ra_head + cnt) % RA_QUEUE_SIZE;
+		ra_cnt -= cnt;
+		lock_release(&ra_lock);
+
+		// Sectors at either end of the run that are cached need no I/O
+		lock_acquire(&buffer_cache_lock);
+		while (cnt > 0 && cache_lookup(first) != NULL){
+			first++;
+			cnt--;
+		}
+		while (cnt > 0 && cache_lookup(first + cnt - 1) != NULL)
+			cnt--;
+		if (cache_closing || cnt == 0){
+			lock_release(&buffer_cache_lock);
+			continue;
+		}
+		if (cnt == 1){
+			struct cache_entry *entry = cache_load(first, true, NULL);
+			// Not used yet: first to go if the prediction was wrong
+			entry->accessed = false;
+			unpin(entry);
+			lock_release(&buffer_cache_lock);
+			continue;
+		}
+		unsigned gen = write_back_gen;
+		lock_release(&buffer_cache_lock);
+
+		disk_read_multi(filesys_disk, first, cnt, ra_buf);
+
+		// A sector written back since the read began may be newer on
+		// disk than in ra_buf; read-ahead is only a hint, so the rest
+		// of the run is dropped then. So it is if an entry could only
+		// be had by waiting, which would let others in meanwhile.
+		lock_acquire(&buffer_cache_lock);
+		if (!cache_closing){
+			size_t i;
+			for (i = 0; i < cnt; i++){
+				if (gen != write_back_gen
+				    || (buffer_cache_size == CACHE_SIZE
+				        && pinned_cnt + flushing_cnt >= buffer_cache_size))
+					break;
+				if (cache_lookup(first + i) != NULL)
+					continue;
+				bool locked;
+				struct cache_entry *entry = cache_load(first + i, false, &locked);
+				// Writing back a victim let others in, who may have
+				// brought the sector in or made ra_buf stale
+				if (!locked){
+					unpin(entry);
+					continue;
+				}
+				if (gen == write_back_gen)
+					memcpy(entry->payload, ra_buf + i * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE);
+				else{
+					lock_release(&buffer_cache_lock);
+					disk_read(filesys_disk, first + i, entry->payload);
+					lock_acquire(&buffer_cache_lock);
+				}
+				rwlock_release_write(&entry->rwlock);
+				entry->accessed = false;
+				unpin(entry);
+			}
+		}
+		lock_release(&buffer_cache_lock);
+	}
+}
+
+// Write-behind thread body
+static void flusher(void *aux UNUSED){
+	int64_t last_flush = timer_ticks();
+	while (!cache_closing){
+		timer_sleep(FLUSH_POLL);
+		if (dirty_cnt >= DIRTY_HIGH || timer_elapsed(last_flush) >= FLUSH_INTERVAL){
+			// Deferred free map changes join this pass
+			if (timer_elapsed(last_flush) >= FLUSH_INTERVAL)
+				free_map_flush();
+			cache_flush();
+			last_flush = timer_ticks();
+		}
+	}
+}
+
+// Writes every dirty entry back in one ascending pass over the disk,
+// so adjacent dirty sectors go out back to back. Payloads are copied
+// out under the lock and written without it; the entries stay cached
+// and unevictable until the pass is over, so nobody can read a stale
+// copy from disk in the meantime.
+static void cache_flush(void){
+	struct cache_entry *batch[CACHE_SIZE];
+	size_t cnt = 0;
+	size_t i;
+	struct list *lists[2] = {&buffer_cache, &a1_queue};
 	struct list_elem *e;
-	int64_t min_time = 9223372036854775807; // int64_t max
-	for (e = list_begin(&buffer_cache); e != list_end(&buffer_cache); e = list_next(e)){
-		temp = list_entry(e, struct cache_entry, elem);
+
+	lock_acquire(&buffer_cache_lock);
+	if (cache_closing || dirty_cnt == 0){
+		lock_release(&buffer_cache_lock);
+		return;
+	}
+	for (i = 0; i < 2; i++)
+		for (e = list_begin(lists[i]); e != list_end(lists[i]); e = list_next(e)){
+			struct cache_entry *entry = list_entry(e, struct cache_entry, elem);
+			// Pinned entries may be in the middle of a write, and those
+			// being written back already; they are picked up by a later
+			// pass
+			if (entry->dirty && evictable(entry))
+				batch[cnt++] = entry;
+		}
+	qsort(batch, cnt, sizeof *batch, sector_less);
+	for (i = 0; i < cnt; i++){
+		memcpy(flush_buf + i * DISK_SECTOR_SIZE, batch[i]->payload, DISK_SECTOR_SIZE);
+		set_dirty_flag(batch[i], false);
+		batch[i]->flushing = true;
+	}
+	flushing_cnt += cnt;
+	lock_release(&buffer_cache_lock);
+
+	// The batch is sorted, so each run of consecutive sectors sits
+	// contiguously in flush_buf and goes out with one command
+	for (i = 0; i < cnt; ){
+		size_t n = 1;
+		while (i + n < cnt && batch[i + n]->sector_num == batch[i]->sector_num + n)
+			n++;
+		disk_write_multi(filesys_disk, batch[i]->sector_num, n, flush_buf + i * DISK_SECTOR_SIZE);
+		i += n;
+	}
+
+	lock_acquire(&buffer_cache_lock);
+	for (i = 0; i < cnt; i++)
+		batch[i]->flushing = false;
+	flushing_cnt -= cnt;
+	write_back_gen++;
+	cond_broadcast(&entry_freed, &buffer_cache_lock);
+	lock_release(&buffer_cache_lock);
+}
+
+static int sector_less(const void *a, const void *b){
+	const struct cache_entry *entry1 = *(struct cache_entry * const *) a;
+	const struct cache_entry *entry2 = *(struct cache_entry * const *) b;
+	if (entry1->sector_num < entry2->sector_num)
+		return -1;
+	return entry1->sector_num > entry2->sector_num;
+}
+
+// Entry caching SECTOR_NUM or NULL; buffer_cache_lock must be held
+static struct cache_entry *cache_lookup(disk_sector_t sector_num){
+	struct cache_entry key;
+	key.sector_num = sector_num;
+	struct hash_elem *e = hash_find(&buffer_cache_map, &key.h_elem);
+	if (e == NULL)
+		return NULL;
+	return hash_entry(e, struct cache_entry, h_elem);
+}
+
+// Entry to be replaced according to cache_policy, NULL if every entry
+// is pinned or being written back. Cache must be full.
+static struct cache_entry *victim_sector(){
+	switch (cache_policy){
+		case CACHE_LRU:
+			return first_evictable(&buffer_cache);
+		case CACHE_2Q:
+			return victim_2q();
+		case CACHE_CLOCK:
+		default:
+			return victim_clock();
+	}
+}
+
+// Sweeps the hand over buffer_cache, giving every accessed entry a
+// second chance, and stops at the first one not accessed since the
+// previous sweep. Two full turns find nothing only if nothing is
+// evictable.
+static struct cache_entry *victim_clock(){
+	size_t n;
+	for (n = 0; n < 2 * buffer_cache_size; n++){
+		if (clock_hand == NULL || clock_hand == list_end(&buffer_cache))
+			clock_hand = list_begin(&buffer_cache);
+		struct cache_entry *temp = list_entry(clock_hand, struct cache_entry, elem);
+		clock_hand = list_next(clock_hand);
+		if (!evictable(temp))
+			continue;
 		if (!temp->accessed)
 			return temp;
-		else{
-			if (temp->access_time < min_time){
-				ans = temp;
-				min_time = temp->access_time;
-			}
-		}
+		temp->accessed = false;
 	}
+	return NULL;
+}
+
+// Oldest once-touched entry while A1 is over its share,
+// otherwise least recently used re-touched entry
+static struct cache_entry *victim_2q(){
+	struct cache_entry *ans = NULL;
+	if (a1_size > A1_MAX)
+		ans = first_evictable(&a1_queue);
+	if (ans == NULL)
+		ans = first_evictable(&buffer_cache);
+	if (ans == NULL)
+		ans = first_evictable(&a1_queue);
 	return ans;
-}
\ No newline at end of file
+}
+
+// Oldest evictable entry of LIST, or NULL
+static struct cache_entry *first_evictable(struct list *list){
+	struct list_elem *e;
+	for (e = list_begin(list); e != list_end(list); e = list_next(e)){
+		struct cache_entry *temp = list_entry(e, struct cache_entry, elem);
+		if (evictable(temp))
+			return temp;
+	}
+	return NULL;
+}
+
+// Neither in use nor being written back
+static bool evictable(const struct cache_entry *entry){
+	return entry->pin_cnt == 0 && !entry->flushing;
+}
+
+static unsigned hash_func(const struct hash_elem *e, void *aux UNUSED){
+	struct cache_entry *entry = hash_entry(e, struct cache_entry, h_elem);
+	return hash_int((int) entry->sector_num);
+}
+
+static bool less_func(const struct hash_elem *e1, const struct hash_elem *e2, void *aux UNUSED){
+	struct cache_entry *entry1 = hash_entry(e1, struct cache_entry, h_elem);
+	struct cache_entry *entry2 = hash_entry(e2, struct cache_entry, h_elem);
+	return entry1->sector_num < entry2->sector_num;
+}
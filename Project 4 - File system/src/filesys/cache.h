@@ -1,23 +1,52 @@
-
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
 
 #include "devices/disk.h"
 #include "threads/synch.h"
 #include <list.h>
+#include <hash.h>
 
 struct list buffer_cache;
 struct lock buffer_cache_lock;
 size_t buffer_cache_size;		// to avoid O(n) cache size computation
 
+#define CACHE_SIZE 64
+#define CACHE_NO_SECTOR ((disk_sector_t) -1)	// sector_num of an invalidated entry
+
+// Replacement policies, selected at boot with -cache-policy=
+enum cache_policy{
+	CACHE_CLOCK,		// second chance over buffer_cache, using accessed bit
+	CACHE_LRU,			// buffer_cache kept in recency order
+	CACHE_2Q			// first-touch FIFO in front of an LRU queue
+};
+
+extern enum cache_policy cache_policy;
+
 struct cache_entry{
 	bool accessed;
 	bool dirty;
-	int64_t access_time;
+	bool in_a1;			// 2Q: still in the first-touch queue
+	bool flushing;		// write-back in progress, must not be replaced
+	unsigned pin_cnt;	// users of the payload, must not be replaced
+	struct rwlock rwlock;	// shared by readers of the payload, held
+						// exclusively while it is written or read in
 	disk_sector_t sector_num;
 	uint8_t payload[DISK_SECTOR_SIZE];
 	struct list_elem elem;
+	struct hash_elem h_elem;	// element of sector number index
 };
 
 void buffer_cache_init();
-struct cache_entry *cache_get_sector(disk_sector_t sector_num, bool set_dirty);
-struct cache_entry *cache_fetch_sector(disk_sector_t sector_num, bool set_dirty);
-void free_cache();
\ No newline at end of file
+bool cache_set_policy(const char *name);
+struct cache_entry *cache_acquire(disk_sector_t sector_num, bool exclusive);
+void cache_release(struct cache_entry *entry, bool exclusive);
+void cache_read(disk_sector_t sector_num, void *buffer, size_t ofs, size_t size);
+void cache_write(disk_sector_t sector_num, const void *buffer, size_t ofs, size_t size);
+void cache_write_new(disk_sector_t sector_num, const void *buffer, size_t ofs, size_t size);
+void cache_mark_dirty(struct cache_entry *entry);
+void cache_invalidate(disk_sector_t sector_num);
+void cache_read_ahead(disk_sector_t sector_num);
+void free_cache();
+void cache_print_stats(void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,197 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Dentry cache: remembers what looking up NAME in the directory
+   whose inode is in sector PARENT found, including that nothing
+   was found.  Path resolution probes it before reading any
+   directory.  Entries come from a fixed table and are recycled
+   in LRU order, so the cache never allocates memory. */
+
+#define DCACHE_SIZE 256         /* Number of entries. */
+#define DCACHE_BUCKETS 64       /* Number of hash chains. */
+
+struct dentry
+  {
+    struct list_elem chain_elem;        /* Element in a hash chain. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    bool in_use;                        /* Holds a name? */
+    disk_sector_t parent;               /* Directory looked up in. */
+    char name[NAME_MAX + 1];            /* Name looked up. */
+    bool negative;                      /* Name does not exist? */
+    disk_sector_t child;                /* Its inode, if it exists. */
+    bool is_dir;                        /* Is that a directory? */
+  };
+
+static struct dentry dentries[DCACHE_SIZE];
+static struct list chains[DCACHE_BUCKETS];
+static struct list lru_list;            /* Most recently used first. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+static struct list *chain_of (disk_sector_t parent, const char *name);
+static struct dentry *find (disk_sector_t parent, const char *name);
+static void put (disk_sector_t parent, const char *name, bool negative,
+                 disk_sector_t child, bool is_dir);
+static void drop (struct dentry *);
+
+/* Initializes the dentry cache, empty. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  lock_init (&dcache_lock);
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_BUCKETS; i++)
+    list_init (&chains[i]);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      dentries[i].in_use = false;
+      list_push_back (&lru_list, &dentries[i].lru_elem);
+    }
+}
+
+/* Looks up NAME in directory PARENT in the cache.  On a hit,
+   stores the inode sector of NAME into *CHILD and whether it is
+   a directory into *IS_DIR. */
+enum dcache_result
+dcache_lookup (disk_sector_t parent, const char *name,
+               disk_sector_t *child, bool *is_dir)
+{
+  enum dcache_result result = DCACHE_MISS;
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      if (d->negative)
+        result = DCACHE_NEGATIVE;
+      else
+        {
+          *child = d->child;
+          *is_dir = d->is_dir;
+          result = DCACHE_HIT;
+        }
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records that NAME in directory PARENT is the inode in sector
+   CHILD, a directory if IS_DIR. */
+void
+dcache_insert (disk_sector_t parent, const char *name,
+               disk_sector_t child, bool is_dir)
+{
+  put (parent, name, false, child, is_dir);
+}
+
+/* Records that directory PARENT has no entry NAME. */
+void
+dcache_insert_negative (disk_sector_t parent, const char *name)
+{
+  put (parent, name, true, 0, false);
+}
+
+/* Forgets what is known about NAME in directory PARENT.  Called
+   whenever an entry is added to or removed from a directory. */
+void
+dcache_invalidate (disk_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    drop (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets everything looked up in directory DIR, which is being
+   removed, so that nothing stale is found if its sector is
+   reused. */
+void
+dcache_invalidate_dir (disk_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dentries[i].in_use && dentries[i].parent == dir)
+      drop (&dentries[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Returns the hash chain for NAME in PARENT. */
+static struct list *
+chain_of (disk_sector_t parent, const char *name)
+{
+  return &chains[(hash_string (name) ^ hash_int (parent)) % DCACHE_BUCKETS];
+}
+
+/* Returns the entry for NAME in PARENT, or a null pointer.
+   dcache_lock must be held. */
+static struct dentry *
+find (disk_sector_t parent, const char *name)
+{
+  struct list *chain = chain_of (parent, name);
+  struct list_elem *e;
+
+  for (e = list_begin (chain); e != list_end (chain); e = list_next (e))
+    {
+      struct dentry *d = list_entry (e, struct dentry, chain_elem);
+      if (d->parent == parent && !strcmp (d->name, name))
+        return d;
+    }
+  return NULL;
+}
+
+/* Stores an entry for NAME in PARENT, replacing any previous one
+   or else the least recently used entry.  Names too long to be
+   in a directory are not cached. */
+static void
+put (disk_sector_t parent, const char *name, bool negative,
+     disk_sector_t child, bool is_dir)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d == NULL)
+    {
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->in_use)
+        list_remove (&d->chain_elem);
+      d->in_use = true;
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      list_push_front (chain_of (parent, name), &d->chain_elem);
+    }
+  d->negative = negative;
+  d->child = child;
+  d->is_dir = is_dir;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Makes D free and the next to be recycled.  dcache_lock must be
+   held. */
+static void
+drop (struct dentry *d)
+{
+  list_remove (&d->chain_elem);
+  d->in_use = false;
+  list_remove (&d->lru_elem);
+  list_push_back (&lru_list, &d->lru_elem);
+}
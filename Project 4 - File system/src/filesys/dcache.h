@@ -0,0 +1,24 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Outcome of a dentry cache probe. */
+enum dcache_result
+  {
+    DCACHE_MISS,                /* Nothing known about the name. */
+    DCACHE_NEGATIVE,            /* The name is known not to exist. */
+    DCACHE_HIT                  /* The name's inode is known. */
+  };
+
+void dcache_init (void);
+enum dcache_result dcache_lookup (disk_sector_t parent, const char *name,
+                                  disk_sector_t *child, bool *is_dir);
+void dcache_insert (disk_sector_t parent, const char *name,
+                    disk_sector_t child, bool is_dir);
+void dcache_insert_negative (disk_sector_t parent, const char *name);
+void dcache_invalidate (disk_sector_t parent, const char *name);
+void dcache_invalidate_dir (disk_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -1,7 +1,10 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -13,12 +16,81 @@
 /* A single directory entry. */
 
 
+/* Directories come in two layouts.  A linear directory is an
+   array of struct dir_entry.  A hashed directory starts with a
+   struct dir_header in block 0, followed by BUCKET_CNT bucket
+   blocks and then by overflow blocks.  A name lives in bucket
+   hash_string (name) % BUCKET_CNT or in one of the overflow blocks
+   chained to it.  Blocks that were never written are holes and
+   read as empty buckets, so unused buckets take no disk space. */
+
+/* Identifies a hashed directory.  Too large to be the sector of
+   the first entry of a linear directory. */
+#define DIR_HASH_MAGIC 0x48524944
+
+/* Directories created for at least this many entries are hashed.
+   Linear directories are converted once they grow past it, and
+   hashed ones double their buckets once there are as many
+   overflow blocks as buckets. */
+#define DIR_HASH_MIN_ENTRIES 50
+
+#define DIR_MIN_BUCKETS 16
+#define DIR_MAX_BUCKETS 1024
+
+#define DIR_BLOCK_ENTRIES 25    /* Entries per bucket block. */
+
+/* Block 0 of a hashed directory.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_header
+  {
+    unsigned magic;                     /* DIR_HASH_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t block_cnt;                 /* Blocks in use, header included. */
+    uint8_t unused[500];                /* Not used. */
+  };
+
+/* A bucket or overflow block of a hashed directory.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct dir_block
+  {
+    uint32_t next;                      /* Next overflow block, 0 if none. */
+    uint32_t unused;                    /* Not used. */
+    struct dir_entry entries[DIR_BLOCK_ENTRIES];
+    uint8_t pad[4];                     /* Not used. */
+  };
+
+static bool hashed_create (struct inode *, size_t entry_cnt);
+static bool read_header (struct inode *, struct dir_header *);
+static bool hashed_lookup (struct inode *, const struct dir_header *,
+                           const char *name, struct dir_entry *, off_t *);
+static bool hashed_add (struct inode *, struct dir_header *,
+                        const struct dir_entry *);
+static bool hashed_convert (struct inode *, off_t end);
+static bool hashed_grow (struct inode *, struct dir_header *);
+static bool readdir (struct dir *, char name[NAME_MAX + 1]);
+static bool dir_step (disk_sector_t *sector, const char *name);
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Large directories get the hashed layout.
+   Returns true if successful, false on failure. */
 bool
 dir_create (disk_sector_t sector, size_t entry_cnt) 
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry), false);
+  ASSERT (sizeof (struct dir_header) == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct dir_block) == DISK_SECTOR_SIZE);
+
+  if (entry_cnt < DIR_HASH_MIN_ENTRIES)
+    return inode_create (sector, entry_cnt * sizeof (struct dir_entry), false);
+
+  struct inode *inode;
+  bool success = inode_create (sector, 0, false);
+  if (success)
+    {
+      inode = inode_open (sector);
+      success = inode != NULL && hashed_create (inode, entry_cnt);
+      inode_close (inode);
+    }
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -85,11 +157,15 @@ lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
+  struct dir_header h;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir->inode, &h))
+    return hashed_lookup (dir->inode, &h, name, ep, ofsp);
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -112,15 +188,38 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  disk_sector_t parent, child;
+  bool is_dir;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  // TODO: lock inode of dir
+  parent = inode_get_inumber (dir->inode);
+  switch (dcache_lookup (parent, name, &child, &is_dir))
+    {
+    case DCACHE_HIT:
+      *inode = inode_open (child);
+      return *inode != NULL;
+    case DCACHE_NEGATIVE:
+      *inode = NULL;
+      return false;
+    case DCACHE_MISS:
+      break;
+    }
+
+  inode_lock (dir->inode);
   if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+    {
+      *inode = inode_open (e.inode_sector);
+      if (*inode != NULL)
+        dcache_insert (parent, name, e.inode_sector, !inode_is_file (*inode));
+    }
   else
-    *inode = NULL;
+    {
+      *inode = NULL;
+      dcache_insert_negative (parent, name);
+    }
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -135,16 +234,19 @@ bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) 
 {
   struct dir_entry e;
+  struct dir_header h;
   off_t ofs;
   bool success = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
-  // TODO: lock inode
+
   /* Check NAME for validity. */
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  inode_lock (dir->inode);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
@@ -152,6 +254,19 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
   if (!inode_make_parent(inode_get_inumber(dir->inode), inode_sector))
     goto done;
 
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+
+  /* Lookups that miss the dentry cache wait for the lock we hold,
+     so dropping the negative entry first leaves nothing stale. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (read_header (dir->inode, &h))
+    {
+      success = hashed_add (dir->inode, &h, &e);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -159,18 +274,27 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector)
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
+  struct dir_entry slot;
+  for (ofs = 0; inode_read_at (dir->inode, &slot, sizeof slot, ofs) == sizeof slot;
+       ofs += sizeof slot) 
+    if (!slot.in_use)
       break;
 
+  /* A full directory that has grown large switches to hashing. */
+  if (ofs == inode_length (dir->inode)
+      && ofs / (off_t) sizeof e >= DIR_HASH_MIN_ENTRIES)
+    {
+      success = hashed_convert (dir->inode, ofs)
+                && read_header (dir->inode, &h)
+                && hashed_add (dir->inode, &h, &e);
+      goto done;
+    }
+
   /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  inode_unlock (dir->inode);
   return success;
 }
 
@@ -183,12 +307,14 @@ dir_remove (struct dir *dir, const char *name)
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
+  bool locked = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  // TODO: lock inode
+  inode_lock (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -198,6 +324,14 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* A directory stays locked until its entry is gone, so that
+     nothing can be added to it after the emptiness check. */
+  if (!inode_is_file(inode))
+    {
+      inode_lock (inode);
+      locked = true;
+    }
+
   /* Reject removing if directory is non-empty */
   if (!inode_is_file(inode) && !dir_is_empty(inode))
     goto done;
@@ -207,6 +341,9 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
   
   /* Erase directory entry. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
+  if (!inode_is_file (inode))
+    dcache_invalidate_dir (e.inode_sector);
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
@@ -216,7 +353,10 @@ dir_remove (struct dir *dir, const char *name)
   success = true;
 
  done:
+  if (locked)
+    inode_unlock (inode);
   inode_close (inode);
+  inode_unlock (dir->inode);
   return success;
 }
 
@@ -225,12 +365,39 @@ dir_remove (struct dir *dir, const char *name)
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  bool found;
+
+  inode_lock (dir->inode);
+  found = readdir (dir, name);
+  inode_unlock (dir->inode);
+  return found;
+}
+
+/* dir_readdir() without taking the directory lock. */
+static bool
+readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  struct dir_header h;
+  bool hashed = read_header (dir->inode, &h);
+  const off_t first = offsetof (struct dir_block, entries);
+  const off_t end = first + DIR_BLOCK_ENTRIES * sizeof e;
 
-  // TODO: lock inode
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  for (;;)
     {
+      if (hashed)
+        {
+          /* Skip the header and the ends of blocks. */
+          if (dir->pos < DISK_SECTOR_SIZE)
+            dir->pos = DISK_SECTOR_SIZE + first;
+          else if (dir->pos % DISK_SECTOR_SIZE >= end)
+            dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE) + first;
+          if (dir->pos / DISK_SECTOR_SIZE >= (off_t) h.block_cnt)
+            return false;
+        }
+      if (inode_read_at (dir->inode, &e, sizeof e, dir->pos) != sizeof e)
+        return false;
       dir->pos += sizeof e;
       if (e.in_use)
         {
@@ -238,19 +405,268 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
           return true;
         } 
     }
-  return false;
 }
 
+/* Fills up to CNT RECORDS with the entries of DIR that follow
+   its current position, reading whole runs of entries at a time
+   instead of one entry per call.  Returns the number of records
+   filled, which is 0 once the directory is exhausted. */
+size_t
+dir_readdir_bulk (struct dir *dir, struct dir_record *records, size_t cnt)
+{
+  struct dir_entry run[DIR_BLOCK_ENTRIES];
+  struct dir_header h;
+  const off_t first = offsetof (struct dir_block, entries);
+  const off_t end = first + sizeof run;
+  size_t filled = 0;
+  bool hashed;
+
+  inode_lock (dir->inode);
+  hashed = read_header (dir->inode, &h);
+  while (filled < cnt)
+    {
+      off_t size = sizeof run;
+      size_t i, n;
+
+      if (hashed)
+        {
+          /* Read the rest of the current block's entries. */
+          if (dir->pos < DISK_SECTOR_SIZE)
+            dir->pos = DISK_SECTOR_SIZE + first;
+          else if (dir->pos % DISK_SECTOR_SIZE >= end)
+            dir->pos = ROUND_UP (dir->pos, DISK_SECTOR_SIZE) + first;
+          if (dir->pos / DISK_SECTOR_SIZE >= (off_t) h.block_cnt)
+            break;
+          size = end - dir->pos % DISK_SECTOR_SIZE;
+        }
+      n = inode_read_at (dir->inode, run, size, dir->pos) / sizeof *run;
+      if (n == 0)
+        break;
+
+      for (i = 0; i < n && filled < cnt; i++)
+        {
+          struct dir_record *r = &records[filled];
+          disk_sector_t child;
+          bool is_dir;
+
+          dir->pos += sizeof *run;
+          if (!run[i].in_use)
+            continue;
+
+          /* The dentry cache usually knows the type; otherwise
+             it takes a look at the inode. */
+          if (dcache_lookup (inode_get_inumber (dir->inode), run[i].name,
+                             &child, &is_dir) != DCACHE_HIT)
+            {
+              struct inode *inode = inode_open (run[i].inode_sector);
+              is_dir = inode != NULL && !inode_is_file (inode);
+              inode_close (inode);
+            }
+          r->inumber = run[i].inode_sector;
+          r->is_dir = is_dir;
+          strlcpy (r->name, run[i].name, sizeof r->name);
+          filled++;
+        }
+    }
+  inode_unlock (dir->inode);
+  return filled;
+}
 
+/* Returns true if the directory in INODE has no entries.  The
+   caller must hold the directory's lock. */
 bool dir_is_empty(struct inode *inode){
-  struct dir_entry e;
-  off_t pos = 0;
-  while(inode_read_at(inode, &e, sizeof e, pos) == sizeof e){
-      pos += sizeof e;
-      if(e.in_use)
-        return false;
-  }
-  return true;
+  struct dir dir = {inode, 0};
+  char name[NAME_MAX + 1];
+  return !readdir (&dir, name);
+}
+
+/* Reads the header of the directory in INODE into *H.  Returns
+   true if the directory is hashed, false if it is linear. */
+static bool
+read_header (struct inode *inode, struct dir_header *h)
+{
+  off_t size = offsetof (struct dir_header, unused);
+  return inode_read_at (inode, h, size, 0) == size && h->magic == DIR_HASH_MAGIC;
+}
+
+/* Returns the number of buckets for a directory of ENTRY_CNT
+   entries, filling each bucket about half way. */
+static uint32_t
+bucket_cnt (size_t entry_cnt)
+{
+  uint32_t cnt = DIR_MIN_BUCKETS;
+  while (cnt < DIR_MAX_BUCKETS && cnt * DIR_BLOCK_ENTRIES / 2 < entry_cnt)
+    cnt *= 2;
+  return cnt;
+}
+
+/* Writes the header of an empty hashed directory sized for
+   ENTRY_CNT entries to INODE.  The buckets are left as holes. */
+static bool
+hashed_create (struct inode *inode, size_t entry_cnt)
+{
+  off_t size = offsetof (struct dir_header, unused);
+  struct dir_header h;
+  h.magic = DIR_HASH_MAGIC;
+  h.bucket_cnt = bucket_cnt (entry_cnt);
+  h.block_cnt = 1 + h.bucket_cnt;
+  return inode_write_at (inode, &h, size, 0) == size;
+}
+
+/* Reads block BLOCK of the hashed directory in INODE into *B.
+   The part of a block past the end of the directory reads as
+   zeros, like a hole. */
+static void
+read_block (struct inode *inode, uint32_t block, struct dir_block *b)
+{
+  off_t n = inode_read_at (inode, b, sizeof *b, (off_t) block * DISK_SECTOR_SIZE);
+  memset ((uint8_t *) b + n, 0, sizeof *b - n);
+}
+
+/* Searches the hashed directory in INODE, whose header is H, for
+   NAME.  Works like lookup(). */
+static bool
+hashed_lookup (struct inode *inode, const struct dir_header *h,
+               const char *name, struct dir_entry *ep, off_t *ofsp)
+{
+  struct dir_block b;
+  uint32_t block = 1 + hash_string (name) % h->bucket_cnt;
+  int i;
+
+  while (block != 0)
+    {
+      off_t ofs = (off_t) block * DISK_SECTOR_SIZE;
+      read_block (inode, block, &b);
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (b.entries[i].in_use && !strcmp (name, b.entries[i].name))
+          {
+            if (ep != NULL)
+              *ep = b.entries[i];
+            if (ofsp != NULL)
+              *ofsp = ofs + offsetof (struct dir_block, entries)
+                      + i * sizeof b.entries[i];
+            return true;
+          }
+      block = b.next;
+    }
+  return false;
+}
+
+/* Stores E in a free slot of its bucket in the hashed directory
+   in INODE, whose header is H, chaining a new overflow block to
+   the bucket if it is full.  May rebuild the directory with more
+   buckets, updating *H. */
+static bool
+hashed_add (struct inode *inode, struct dir_header *h,
+            const struct dir_entry *e)
+{
+  struct dir_block b;
+  uint32_t block = 1 + hash_string (e->name) % h->bucket_cnt;
+  off_t ofs;
+  int i;
+
+  for (;;)
+    {
+      ofs = (off_t) block * DISK_SECTOR_SIZE;
+      read_block (inode, block, &b);
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (!b.entries[i].in_use)
+          {
+            ofs += offsetof (struct dir_block, entries) + i * sizeof *e;
+            return inode_write_at (inode, e, sizeof *e, ofs) == sizeof *e;
+          }
+      if (b.next == 0)
+        break;
+      block = b.next;
+    }
+
+  if (h->block_cnt - 1 - h->bucket_cnt >= h->bucket_cnt
+      && h->bucket_cnt < DIR_MAX_BUCKETS)
+    return hashed_grow (inode, h) && hashed_add (inode, h, e);
+
+  /* Put E first in a new overflow block, then link it in. */
+  uint32_t next = h->block_cnt;
+  memset (&b, 0, sizeof b);
+  b.entries[0] = *e;
+  if (inode_write_at (inode, &b, sizeof b, (off_t) next * DISK_SECTOR_SIZE)
+      != sizeof b)
+    return false;
+  h->block_cnt++;
+  return (inode_write_at (inode, &h->block_cnt, sizeof h->block_cnt,
+                          offsetof (struct dir_header, block_cnt))
+          == sizeof h->block_cnt)
+         && (inode_write_at (inode, &next, sizeof next, ofs)
+             == sizeof next);
+}
+
+/* Lays out the directory in INODE afresh as a hashed directory
+   sized for ENTRY_CNT entries and holding the CNT ENTRIES.  The
+   old contents end at byte END; the blocks they used past the
+   header are cleared first.  Reads the new header into *H. */
+static bool
+hashed_rebuild (struct inode *inode, const struct dir_entry *entries,
+                size_t cnt, off_t end, size_t entry_cnt,
+                struct dir_header *h)
+{
+  static const struct dir_block empty;
+  off_t ofs;
+  size_t i;
+  bool success = true;
+
+  for (ofs = DISK_SECTOR_SIZE; success && ofs < end; ofs += DISK_SECTOR_SIZE)
+    success = inode_write_at (inode, &empty, sizeof empty, ofs) == sizeof empty;
+  success = success && hashed_create (inode, entry_cnt) && read_header (inode, h);
+  for (i = 0; success && i < cnt; i++)
+    if (entries[i].in_use)
+      success = hashed_add (inode, h, &entries[i]);
+  return success;
+}
+
+/* Rewrites the full linear directory in INODE, whose entries end
+   at byte END, in the hashed layout. */
+static bool
+hashed_convert (struct inode *inode, off_t end)
+{
+  size_t cnt = end / sizeof (struct dir_entry);
+  struct dir_entry *entries = malloc (end);
+  struct dir_header h;
+  bool success;
+
+  if (entries == NULL)
+    return false;
+  success = (inode_read_at (inode, entries, end, 0) == end
+             && hashed_rebuild (inode, entries, cnt, end, 2 * cnt, &h));
+  free (entries);
+  return success;
+}
+
+/* Rebuilds the hashed directory in INODE, whose header is *H,
+   with twice as many buckets. */
+static bool
+hashed_grow (struct inode *inode, struct dir_header *h)
+{
+  struct dir_block b;
+  size_t max = (h->block_cnt - 1) * DIR_BLOCK_ENTRIES;
+  struct dir_entry *entries = malloc (max * sizeof *entries);
+  size_t cnt = 0;
+  uint32_t block;
+  int i;
+  bool success;
+
+  if (entries == NULL)
+    return false;
+  for (block = 1; block < h->block_cnt; block++)
+    {
+      read_block (inode, block, &b);
+      for (i = 0; i < DIR_BLOCK_ENTRIES; i++)
+        if (b.entries[i].in_use)
+          entries[cnt++] = b.entries[i];
+    }
+  success = hashed_rebuild (inode, entries, cnt,
+                            (off_t) h->block_cnt * DISK_SECTOR_SIZE,
+                            h->bucket_cnt * DIR_BLOCK_ENTRIES, h);
+  free (entries);
+  return success;
 }
 
 bool dir_is_root(struct dir *dir){
@@ -273,40 +689,76 @@ bool dir_get_parent(struct dir *dir, struct inode **inode){
 
 /*
   If path is "/root/home/zhanto", returns struct dir for directory "home"
+  Components are resolved through the dentry cache; directories
+  are only read when it misses.
 */
 struct dir *dir_from_path(char *path){
   unsigned len = strlen(path);
   char copy[len + 1];
   memcpy(copy, path, len + 1);
 
-  struct dir *dir;
+  disk_sector_t sector;
   if (copy[0] == '/' || thread_current()->cur_dir == NULL)
-    dir = dir_open_root();
+    sector = ROOT_DIR_SECTOR;
   else
-    dir = dir_reopen(thread_current()->cur_dir);
+    sector = inode_get_inumber(dir_get_inode(thread_current()->cur_dir));
   
   char *saveptr;
   char *token = strtok_r(copy, "/", &saveptr);
   char *next = strtok_r(NULL, "/", &saveptr);
   while(next){
-    if (strcmp(token, ".") != 0){
-      struct inode *inode;
-      if (strcmp(token, "..") == 0 && !dir_get_parent(dir, &inode))
-        return NULL;
-      if (!dir_lookup(dir, token, &inode))
-        return NULL;
-
-      if (!inode_is_file(inode)){
-        dir_close(dir);
-        dir = dir_open(inode);
-      }
-      else
-        inode_close(inode);
-    }
+    if (strcmp(token, ".") != 0 && !dir_step(&sector, token))
+      return NULL;
     token = next;
     next = strtok_r(NULL, "/", &saveptr);
   }
-  return dir;
+  return dir_open(inode_open(sector));
+}
+
+/* Moves *SECTOR, the inode sector of a directory, to that of its
+   subdirectory NAME, or of its parent if NAME is "..".  A NAME
+   that is a file leaves *SECTOR as it is.  Returns false if NAME
+   does not exist. */
+static bool
+dir_step (disk_sector_t *sector, const char *name)
+{
+  disk_sector_t child = 0;
+  bool is_dir = false;
+  enum dcache_result result = dcache_lookup (*sector, name, &child, &is_dir);
+
+  if (result == DCACHE_MISS)
+    {
+      struct inode *inode = inode_open (*sector);
+      if (inode == NULL)
+        return false;
+      if (!strcmp (name, ".."))
+        {
+          child = inode_parent_sector (inode);
+          is_dir = true;
+          dcache_insert (*sector, name, child, true);
+          result = DCACHE_HIT;
+        }
+      else
+        {
+          struct dir dir = {inode, 0};
+          struct inode *found;
+          result = DCACHE_NEGATIVE;
+          if (dir_lookup (&dir, name, &found))
+            {
+              child = inode_get_inumber (found);
+              is_dir = !inode_is_file (found);
+              inode_close (found);
+              result = DCACHE_HIT;
+            }
+        }
+      inode_close (inode);
+    }
+
+  if (result == DCACHE_NEGATIVE)
+    return false;
+  if (is_dir)
+    *sector = child;
+  return true;
 }
 
 /*
@@ -329,4 +781,4 @@ char *dir_last_dir(char *path){
   char *last_dir = (char *) malloc(len + 1);
   memcpy(last_dir, prev, len + 1);
   return last_dir;
-}
\ No newline at end of file
+}
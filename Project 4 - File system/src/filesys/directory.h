@@ -25,6 +25,15 @@ struct dir_entry
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
   };
+
+/* A record filled in by dir_readdir_bulk().  The layout matches
+   struct readdir_entry in lib/user/syscall.h. */
+struct dir_record
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
 /* Opening and closing directories. */
 bool dir_create (disk_sector_t sector, size_t entry_cnt);
 struct dir *dir_open (struct inode *);
@@ -38,6 +47,7 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, disk_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_bulk (struct dir *, struct dir_record *, size_t cnt);
 
 bool dir_get_parent(struct dir *dir, struct inode **inode);
 bool dir_is_root(struct dir *dir);
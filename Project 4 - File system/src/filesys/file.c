@@ -12,8 +12,18 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Offset a sequential reader reads next. */
+    off_t ra_end;               /* End of the range already read ahead. */
+    int ra_window;              /* Read-ahead window, in sectors. */
   };
 
+/* Read-ahead window limits, in sectors.  The window doubles on
+   every sequential read and halves on every random one. */
+#define RA_MIN_WINDOW 2
+#define RA_MAX_WINDOW 16
+
+static void file_read_ahead (struct file *, off_t ofs, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -26,6 +36,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -72,6 +85,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  file_read_ahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -84,7 +98,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  file_read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -170,19 +186,45 @@ file_tell (struct file *file)
   return file->pos;
 }
 
+/* Updates FILE's read-ahead state after BYTES_READ bytes were read
+   at offset OFS, and queues the sectors the window now covers that
+   were not queued before. */
+static void
+file_read_ahead (struct file *file, off_t ofs, off_t bytes_read)
+{
+  off_t start, end;
+
+  if (bytes_read == 0)
+    return;
+  if (ofs == file->ra_next)
+    {
+      file->ra_window *= 2;
+      if (file->ra_window < RA_MIN_WINDOW)
+        file->ra_window = RA_MIN_WINDOW;
+      if (file->ra_window > RA_MAX_WINDOW)
+        file->ra_window = RA_MAX_WINDOW;
+    }
+  else
+    {
+      file->ra_window /= 2;
+      file->ra_end = 0;
+    }
+  file->ra_next = ofs + bytes_read;
+  if (file->ra_window == 0)
+    return;
+
+  start = file->ra_next > file->ra_end ? file->ra_next : file->ra_end;
+  end = file->ra_next + file->ra_window * DISK_SECTOR_SIZE;
+  if (start < end)
+    {
+      inode_read_ahead (file->inode, start, end);
+      file->ra_end = end;
+    }
+}
+
 bool file_readdir(struct file *file, char *name){
   //printf("readdir: name %s\n", name);
-  struct dir *dir = file;
-  struct dir_entry e;
-  // TODO: lock inode of file
-  while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e){
-    dir->pos += sizeof e;
-    if (e.in_use){
-      strlcpy(name, e.name, NAME_MAX + 1);
-      return true;
-    }
-  }
-  return false;
+  return dir_readdir((struct dir *) file, name);
 }
 
 bool file_is_file(struct file *file){
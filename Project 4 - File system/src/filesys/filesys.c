@@ -6,6 +6,7 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
 #include "threads/thread.h"
@@ -15,6 +16,10 @@
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
+/* Lay out inodes created by formatting with extents rather than
+   block tables.  Only read when formatting. */
+bool filesys_extents;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -25,17 +30,24 @@ filesys_init (bool format)
   filesys_disk = disk_get (0, 1);
   if (filesys_disk == NULL)
     PANIC ("hd0:1 (hdb) not present, file system initialization failed");
+
+  lock_init(&filesys_lock);
   
   free_map_init ();
   inode_init ();
+  dcache_init ();
   buffer_cache_init();
   
   if (format) 
-    do_format ();
+    {
+      inode_set_extents (filesys_extents);
+      do_format ();
+    }
 
   free_map_open ();
 
-  lock_init(&filesys_lock);
+  /* New inodes follow the layout the disk was formatted with. */
+  inode_set_extents (inode_is_extent_based (ROOT_DIR_SECTOR));
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -43,8 +55,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
-  free_cache();
+  /* The free map is written through the cache, so close it first. */
   free_map_close ();
+  free_cache();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -62,7 +75,8 @@ filesys_create (const char *name, off_t initial_size, bool isFile)
   //printf("create: dir, is root and filename %p %d %s\n", dir, dir_is_root(dir), filename);
   if (strcmp(filename, ".") != 0 && strcmp(filename, "..") != 0)
     success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (inode_get_inumber (dir_get_inode (dir)),
+                                             1, &inode_sector)
                   && inode_create (inode_sector, initial_size, isFile)
                   && dir_add (dir, filename, inode_sector));
   if (!success && inode_sector != 0) 
@@ -11,6 +11,9 @@
 
 struct lock filesys_lock;
 
+/* -extents: Format with extent based inodes? */
+extern bool filesys_extents;
+
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
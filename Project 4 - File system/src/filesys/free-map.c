@@ -1,12 +1,31 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/cache.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* The disk is split into allocation groups of this many sectors.
+   Allocations start in the group of their hint, and groups without
+   enough free sectors are skipped without looking at the bitmap. */
+#define GROUP_SECTORS 512
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t group_cnt;             /* Number of allocation groups. */
+static size_t *group_free;           /* Free sectors in each group. */
+static struct lock free_map_lock;    /* Protects the four above. */
+
+/* Changed since the free map file was last written?  Changes are
+   written by free_map_flush(), which the buffer cache's flusher
+   calls once per flush interval, and when the free map is closed. */
+static bool free_map_dirty;
+
+static void count_groups (void);
 
 /* Initializes the free map. */
 void
@@ -15,8 +34,82 @@ free_map_init (void)
   free_map = bitmap_create (disk_size (filesys_disk));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--disk is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("allocation group creation failed");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  count_groups ();
+  lock_init (&free_map_lock);
+  free_map_dirty = false;
+}
+
+/* Recounts the free sectors of every allocation group. */
+static void
+count_groups (void)
+{
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+/* Marks the CNT sectors starting at SECTOR as allocated, or as
+   free if ALLOCATED is false, in the free map and the group
+   counts. */
+static void
+mark (disk_sector_t sector, size_t cnt, bool allocated)
+{
+  size_t end = sector + cnt;
+  size_t i;
+
+  bitmap_set_multiple (free_map, sector, cnt, allocated);
+  for (i = sector; i < end; i = ROUND_DOWN (i, GROUP_SECTORS) + GROUP_SECTORS)
+    {
+      size_t group_end = ROUND_DOWN (i, GROUP_SECTORS) + GROUP_SECTORS;
+      size_t n = (end < group_end ? end : group_end) - i;
+      if (allocated)
+        group_free[i / GROUP_SECTORS] -= n;
+      else
+        group_free[i / GROUP_SECTORS] += n;
+    }
+  free_map_dirty = true;
+}
+
+/* Returns the first of CNT free consecutive sectors, looking from
+   HINT onward and then from the start of the disk, or BITMAP_ERROR
+   if there are none. */
+static size_t
+scan_near (disk_sector_t hint, size_t cnt)
+{
+  size_t first = hint / GROUP_SECTORS;
+  size_t g;
+
+  if (first >= group_cnt)
+    first = hint = 0;
+
+  /* Runs longer than a group may span partly free groups. */
+  if (cnt <= GROUP_SECTORS)
+    for (g = first; g < group_cnt && group_free[g] < cnt; g++)
+      continue;
+  else
+    g = first;
+
+  if (g < group_cnt)
+    {
+      size_t start = g == first ? hint : g * GROUP_SECTORS;
+      size_t sector = bitmap_scan (free_map, start, cnt, false);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+  return bitmap_scan (free_map, 0, cnt, false);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -26,26 +119,73 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (0, cnt, sectorp);
+}
+
+/* Like free_map_allocate(), but prefers sectors in the allocation
+   group of HINT, at or after HINT, then the groups that follow. */
+bool
+free_map_allocate_near (disk_sector_t hint, size_t cnt,
+                        disk_sector_t *sectorp) 
+{
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = scan_near (hint, cnt);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      mark (sector, cnt, true);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates the free sectors that start at SECTOR, up to CNT of
+   them, so that a run of sectors can be grown in place.
+   Returns the number of sectors allocated, 0 if SECTOR is in use. */
+size_t
+free_map_extend (disk_sector_t sector, size_t cnt)
+{
+  size_t n = 0;
+
+  lock_acquire (&free_map_lock);
+  while (n < cnt && sector + n < bitmap_size (free_map)
+         && !bitmap_test (free_map, sector + n))
+    n++;
+  if (n > 0)
+    mark (sector, n, true);
+  lock_release (&free_map_lock);
+  return n;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
 {
+  size_t i;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (i = 0; i < cnt; i++)
+    cache_invalidate (sector + i);
+  mark (sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the free map to its file if it changed since the last
+   write. */
+void
+free_map_flush (void)
+{
+  lock_acquire (&free_map_lock);
+  if (free_map_dirty && free_map_file != NULL)
+    {
+      if (!bitmap_write (free_map, free_map_file))
+        PANIC ("can't write free map");
+      free_map_dirty = false;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -57,13 +197,18 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  free_map_flush ();
+  lock_acquire (&free_map_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -82,4 +227,5 @@ free_map_create (void)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  free_map_dirty = false;
 }
@@ -1,7 +1,9 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
@@ -11,14 +13,53 @@
 
 
 
-/* Identifies an inode. */
+/* Identifies a block table inode in the original format, whose
+   entries past the end of the file may hold garbage. */
 #define INODE_MAGIC 0x494e4f44
+/* Identifies a block table inode whose entries past the end of the
+   file are all 0. */
+#define INODE_TABLE_MAGIC 0x494e4f54
+/* Identifies an inode that maps its data with extents. */
+#define INODE_EXTENT_MAGIC 0x494e4f45
+/* Identifies an inode whose data is stored in the inode itself. */
+#define INODE_INLINE_MAGIC 0x494e4f49
 
 #define DIRECT_BLOCKS 12
 #define INDIRECT_BLOCKS 1
 #define DOUBLE_INDIRECT_BLOCKS 1
 #define NUM_DIRECT_PTRS 128   // number of direct pointers in an indirect block (512 / 4 = 128)
 // max file size would be 512*(12 + 128 + 128*128) = 8,460,288 > 8MB
+#define MAX_BLOCKS (DIRECT_BLOCKS + NUM_DIRECT_PTRS + NUM_DIRECT_PTRS*NUM_DIRECT_PTRS)
+
+#define INLINE_EXTENTS 52     // extents stored in the inode itself
+#define OVERFLOW_EXTENTS 63   // extents stored in each overflow block
+#define INLINE_DATA_MAX 428   // bytes of data a file can keep in its inode
+
+/* Set in a block table entry whose sector was allocated but never
+   written.  Such a sector reads as zeros without touching the disk,
+   and its first write does not read it in.  An entry of 0 is a hole:
+   no sector is allocated until the first write. */
+#define SECTOR_UNWRITTEN 0x80000000u
+
+/* A run of LENGTH consecutive sectors starting at START.
+   The sectors of an UNWRITTEN extent read as zeros.  An extent
+   starting at sector 0 is a hole of LENGTH unallocated sectors. */
+struct extent
+  {
+    disk_sector_t start;
+    uint32_t length : 31;
+    uint32_t unwritten : 1;
+  };
+
+/* Overflow block of an extent based inode, holding the extents that
+   do not fit in the inode.  Overflow blocks form a chain.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block
+  {
+    disk_sector_t next;                   /* Next overflow block, 0 if last. */
+    uint32_t unused;                      /* Not used. */
+    struct extent extents[OVERFLOW_EXTENTS];
+  };
 
 /* On-disk inode.
    Must be exactly DISK_SECTOR_SIZE bytes long. */
@@ -26,14 +67,31 @@ struct inode_disk
   {
     off_t length;                         /* File size in bytes. */
     unsigned magic;                       /* Magic number. */
-    disk_sector_t blocks[14];             /* num (direct + indirect + double indirect) */
-    uint32_t direct;                      /* direct block index; if 12, all directs are used up*/
-    uint32_t indirect;                    /* indirect block index; if 128, all indirect blocks are used up */
-    uint32_t double_indirect;             /* double indirect index; if 128*128, all are used up (never happens) */
+    disk_sector_t blocks[14];             /* num (direct + indirect + double indirect), 0 if absent */
+    uint32_t unused[3];                   /* Not used. */
     bool isFile;                          /* Dirctory or file */
     disk_sector_t parent_sector;          /* If directory, contains sector where its parent's inode is located */
-    uint32_t unused[107];                 /* Not used. */
+    union
+      {
+        /* Used only if magic is INODE_EXTENT_MAGIC; blocks are
+           then unused. */
+        struct
+          {
+            uint32_t extent_cnt;          /* Number of extents */
+            uint32_t extent_sectors;      /* Sectors covered by all extents */
+            disk_sector_t extent_block;   /* First overflow block, 0 if none */
+            struct extent extents[INLINE_EXTENTS];
+          };
+        /* Used only if magic is INODE_INLINE_MAGIC, for files of
+           at most INLINE_DATA_MAX bytes.  Bytes past the end of
+           the file are zero. */
+        uint8_t data[INLINE_DATA_MAX];
+      };
   };
+
+/* Format new inodes with extents instead of the
+   direct/indirect/double indirect block tables. */
+static bool use_extents;
   
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -46,69 +104,138 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     disk_sector_t sector;               /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    bool dirty;                         /* Changed since read from disk? */
+    bool closing;                       /* Last close writing it back? */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rwlock;               /* Shared by readers, held exclusively
+                                           by writers. */
+    struct lock map_lock;               /* Protects the lookup memos between
+                                           concurrent readers. */
+    struct lock dir_lock;               /* Serializes directory operations. */
 
     off_t length;
-    uint32_t direct;                      /* direct block index; if 12, all directs are used up*/
-    uint32_t indirect;                    /* indirect block index; if 128, all indirect blocks are used up */
-    uint32_t double_indirect;             /* double indirect index; if 128*128, all are used up (never happens) */
     bool isFile;                          /* Dirctory or file */
     disk_sector_t parent_sector;          /* If directory, contains sector where its parent's inode is located */
     disk_sector_t blocks[14];             /* num (direct + indirect + double indirect) */
+    int memo_index;                       /* Last double indirect entry resolved, -1 if none */
+    disk_sector_t memo_sector;            /* Second-level block it points to */
+
+    bool inline_data;                     /* Data stored in the inode sector? */
+    bool extent_based;                    /* Data mapped by extents? */
+    uint32_t extent_cnt;                  /* Number of extents */
+    uint32_t extent_sectors;              /* Sectors covered by all extents */
+    disk_sector_t extent_block;           /* First overflow block, 0 if none */
+    struct extent extents[INLINE_EXTENTS];
+    uint32_t memo_extent;                 /* Last extent a lookup ended in */
+    uint32_t memo_extent_first;           /* First file sector it maps */
+    disk_sector_t next_alloc;             /* Where the next allocation looks first */
     //struct inode_disk data;             /* Inode content. */
   };
 
 static void inode_free_resources(struct inode *inode);
-static bool inode_expand(struct inode *inode, off_t new_length);
+static bool inode_expand(struct inode *inode, off_t start, off_t new_length);
+static bool inode_expand_extents(struct inode *inode, off_t start, off_t new_length);
+static bool index_slot(struct inode *inode, uint32_t idx, bool allocate, disk_sector_t *table, uint32_t *slot);
+static disk_sector_t index_get(struct inode *inode, disk_sector_t table, uint32_t slot);
+static void index_set(struct inode *inode, disk_sector_t table, uint32_t slot, disk_sector_t sector);
+static void inode_free_extents(struct inode *inode);
+static void extent_get(const struct inode *inode, uint32_t i, struct extent *ext);
+static void extent_set(struct inode *inode, uint32_t i, const struct extent *ext);
+static bool extent_append(struct inode *inode, disk_sector_t start, uint32_t length, bool unwritten);
+static bool extent_find(struct inode *inode, uint32_t idx, uint32_t *ip, uint32_t *firstp, struct extent *ext);
+static disk_sector_t inode_prepare_write(struct inode *inode, off_t pos);
+static void inode_init_mapping(struct inode *inode);
+static bool inode_allocate(struct inode *inode, size_t cnt, disk_sector_t *sector);
+static void inode_from_disk(struct inode *inode, const struct inode_disk *disk_inode);
+static void inode_to_disk(const struct inode *inode, struct inode_disk *disk_inode);
+static bool inode_promote(struct inode *inode);
+static void index_scrub(struct inode *inode);
+static void index_release_empty(struct inode *inode, uint32_t first, uint32_t last);
 
 /* Returns the disk sector that contains byte offset POS within
-   INODE.
+   INODE, with SECTOR_UNWRITTEN set if it was never written, or 0
+   if POS lies in a hole.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
 
   if (pos < inode->length){
     uint32_t idx = pos/DISK_SECTOR_SIZE;
-    if (idx < 12)
-      return inode->blocks[idx];
-    
-    idx-=DIRECT_BLOCKS;
-    if (idx < 128){
-      disk_sector_t block[NUM_DIRECT_PTRS];
-      disk_read(filesys_disk, inode->blocks[12], &block);
-      return block[idx];
-    }
-    idx-=NUM_DIRECT_PTRS;
-    if (idx < 128*128){
-      disk_sector_t block_ptrs[NUM_DIRECT_PTRS];
-      disk_read(filesys_disk, inode->blocks[13], &block_ptrs);
-      int block_index = idx/128;
-      disk_sector_t block[NUM_DIRECT_PTRS];
-      disk_read(filesys_disk, block_ptrs[block_index], &block);
-      return block[idx%128];
+    disk_sector_t sector;
+    if (inode->extent_based){
+      uint32_t i, first;
+      struct extent ext;
+      if (!extent_find(inode, idx, &i, &first, &ext))
+        return -1;
+      sector = ext.start + (idx - first);
+      return ext.unwritten ? sector | SECTOR_UNWRITTEN : sector;
     }
-    return -1;
+    disk_sector_t table;
+    uint32_t slot;
+    if (idx >= MAX_BLOCKS)
+      return -1;
+    if (!index_slot(inode, idx, false, &table, &slot))
+      return 0;
+    return index_get(inode, table, slot);
   }
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
+/* Open inodes by sector, so that opening a single inode twice
    returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+
+/* Protects open_inodes, open_inode_cnt, close_gen and the open
+   counts and closing flags of the inodes in it. */
+static struct lock open_inodes_lock;
+
+/* Signaled when an inode marked closing leaves open_inodes. */
+static struct condition inode_closed;
+
+/* Number of inodes written back by a last close so far. */
+static unsigned close_gen;
+
+/* Number of inodes in open_inodes. */
+static size_t open_inode_cnt;
+
+static unsigned inode_hash (const struct hash_elem *e, void *aux UNUSED);
+static bool inode_less (const struct hash_elem *a, const struct hash_elem *b,
+                        void *aux UNUSED);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  lock_init (&open_inodes_lock);
+  cond_init (&inode_closed);
+  open_inode_cnt = 0;
+}
+
+/* Selects the layout of inodes created from now on: extents if
+   EXTENTS is true, block tables otherwise.  Existing inodes keep
+   their own layout, so both can be read on the same disk. */
+void
+inode_set_extents (bool extents)
+{
+  use_extents = extents;
+}
+
+/* Returns true if the inode in SECTOR maps its data with extents. */
+bool
+inode_is_extent_based (disk_sector_t sector)
+{
+  unsigned magic;
+  cache_read (sector, &magic, offsetof (struct inode_disk, magic), sizeof magic);
+  return magic == INODE_EXTENT_MAGIC;
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -128,34 +255,34 @@ inode_create (disk_sector_t sector, off_t length, bool isFile)
   /* If this assertion fails, the inode structure is not exactly
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
+  ASSERT (sizeof (struct extent_block) == DISK_SECTOR_SIZE);
 
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = 0;
-      disk_inode->magic = INODE_MAGIC;
-      disk_inode->direct = 0;
-      disk_inode->indirect = 0;
-      disk_inode->double_indirect = 0;
-      disk_inode->isFile = isFile;
-      disk_inode->parent_sector = ROOT_DIR_SECTOR;
-
       struct inode inode;
+      memset(&inode, 0, sizeof inode);
+      inode.sector = sector;
       inode.length = 0;
-      inode.direct = 0;
-      inode.indirect = 0;
-      inode.double_indirect = 0;
+      inode.isFile = isFile;
+      inode.parent_sector = ROOT_DIR_SECTOR;
+      inode.inline_data = isFile && length <= INLINE_DATA_MAX;
+      inode.extent_based = use_extents;
+      inode.next_alloc = sector;
+      inode_init_mapping(&inode);
 
-      success = inode_expand(&inode, length);
+      // Inline data starts out as zeros, like the rest of the sector
+      if (inode.inline_data)
+        success = true;
+      else if (inode.extent_based)
+        success = inode_expand_extents(&inode, 0, length);
+      else
+        success = inode_expand(&inode, 0, length);
       //printf("create: success,d,i,di %d %d %d %d\n", success, disk_inode->direct, disk_inode->indirect, disk_inode->double_indirect);
       if (success){
-        disk_inode->length = length;
-        disk_inode->direct = inode.direct;
-        disk_inode->indirect = inode.indirect;
-        disk_inode->double_indirect = inode.double_indirect;
-        memcpy(disk_inode->blocks, inode.blocks, 14*sizeof(disk_sector_t));
-        disk_write(filesys_disk, sector, disk_inode);
+        inode.length = length;
+        inode_to_disk(&inode, disk_inode);
+        cache_write_new(sector, disk_inode, 0, DISK_SECTOR_SIZE);
       }
       /*
       if (free_map_allocate (sectors, &disk_inode->start))
@@ -177,26 +304,50 @@ inode_create (disk_sector_t sector, off_t length, bool isFile)
   return success;
 }
 
+/* Returns the open inode for SECTOR, or a null pointer if there is
+   none.  If that inode is being closed for the last time, waits until
+   it has been written back and is gone, then looks again.
+   Must be called with open_inodes_lock held. */
+static struct inode *
+inode_find (disk_sector_t sector)
+{
+  /* Lookup key, too big for the stack; protected by
+     open_inodes_lock. */
+  static struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  while ((e = hash_find (&open_inodes, &key.elem)) != NULL)
+    {
+      struct inode *inode = hash_entry (e, struct inode, elem);
+      if (!inode->closing)
+        return inode;
+      cond_wait (&inode_closed, &open_inodes_lock);
+    }
+  return NULL;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *other;
+  unsigned gen;
+  bool old_format;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+  inode = inode_find (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode;
     }
+  gen = close_gen;
+  lock_release (&open_inodes_lock);
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
@@ -204,22 +355,53 @@ inode_open (disk_sector_t sector)
     return NULL;
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->dirty = false;
+  inode->closing = false;
+  inode->next_alloc = sector;
+  rwlock_init (&inode->rwlock);
+  lock_init (&inode->map_lock);
+  lock_init (&inode->dir_lock);
+
+  /* Read the inode without holding open_inodes_lock, so that other
+     opens don't wait for the disk.  If a last close wrote an inode
+     back meanwhile, the copy may be stale: read it again. */
+  for (;;)
+    {
+      struct inode_disk disk_inode;
+      cache_read (inode->sector, &disk_inode, 0, DISK_SECTOR_SIZE);
+      inode_from_disk(inode, &disk_inode);
+      old_format = disk_inode.magic == INODE_MAGIC;
+      inode_init_mapping(inode);
+
+      lock_acquire (&open_inodes_lock);
+      other = inode_find (sector);
+      if (other != NULL)
+        {
+          /* Someone else opened it first. */
+          other->open_cnt++;
+          lock_release (&open_inodes_lock);
+          free (inode);
+          return other;
+        }
+      if (gen == close_gen)
+        break;
+      gen = close_gen;
+      lock_release (&open_inodes_lock);
+    }
 
-  struct inode_disk disk_inode;
-  disk_read (filesys_disk, inode->sector, &disk_inode);
+  /* Nobody can use the inode before the write lock is dropped. */
+  rwlock_acquire_write (&inode->rwlock);
+  hash_insert (&open_inodes, &inode->elem);
+  open_inode_cnt++;
+  lock_release (&open_inodes_lock);
 
-  inode->length = disk_inode.length;
-  inode->direct = disk_inode.direct;
-  inode->indirect = disk_inode.indirect;
-  inode->double_indirect = disk_inode.double_indirect;
-  inode->isFile = disk_inode.isFile;
-  inode->parent_sector = disk_inode.parent_sector;
-  memcpy(inode->blocks, disk_inode.blocks, 14*sizeof(disk_sector_t));
+  if (old_format)
+    index_scrub(inode);
+  rwlock_release_write (&inode->rwlock);
   return inode;
 }
 
@@ -228,10 +410,21 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
+/* Returns the number of inodes currently open. */
+size_t
+inode_count_open (void)
+{
+  return open_inode_cnt;
+}
+
 /* Returns INODE's inode number. */
 disk_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -239,7 +432,7 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
-/* Closes INODE and writes it to disk.
+/* Closes INODE and writes it to the buffer cache if it changed.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
@@ -249,35 +442,50 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  /* Release resources if this was the last opener.  The inode stays
+     in open_inodes, marked closing, until it has been written back,
+     so that an inode_open() of the same sector waits for the write
+     instead of reading the old contents from disk. */
+  lock_acquire (&open_inodes_lock);
+  bool last = --inode->open_cnt == 0;
+  if (last)
+    inode->closing = true;
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
+
       /* Deallocate blocks if removed. */
       if (inode->removed) 
       {
-        inode_free_resources(inode);
+        if (inode->inline_data)
+          ;
+        else if (inode->extent_based)
+          inode_free_extents(inode);
+        else
+          inode_free_resources(inode);
         free_map_release (inode->sector, 1);
         /*
         free_map_release (inode->data.start,
                           bytes_to_sectors (inode->data.length)); 
         */
       }
-      else{
+      else if (inode->dirty){
+        // Inline data is written in place, leave it alone
         struct inode_disk disk_inode;
-        disk_inode.length = inode->length;
-        disk_inode.magic = INODE_MAGIC;
-        memcpy(disk_inode.blocks, inode->blocks, 14*sizeof(disk_sector_t));
-        disk_inode.direct = inode->direct;
-        disk_inode.indirect = inode->indirect;
-        disk_inode.double_indirect = inode->double_indirect;
-        disk_inode.isFile = inode->isFile;
-        disk_inode.parent_sector = inode->parent_sector;
-        disk_write(filesys_disk, inode->sector, &disk_inode);
+        inode_to_disk(inode, &disk_inode);
+        cache_write(inode->sector, &disk_inode, 0,
+                    inode->inline_data ? offsetof(struct inode_disk, data)
+                                       : DISK_SECTOR_SIZE);
       }
 
+      lock_acquire (&open_inodes_lock);
+      hash_delete (&open_inodes, &inode->elem);
+      open_inode_cnt--;
+      close_gen++;
+      cond_broadcast (&inode_closed, &open_inodes_lock);
+      lock_release (&open_inodes_lock);
+
       free (inode); 
     }
 }
@@ -301,10 +509,23 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   //uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->inline_data)
+    {
+      if (offset < inode->length)
+        {
+          bytes_read = inode->length - offset < size ? inode->length - offset : size;
+          cache_read (inode->sector, buffer,
+                      offsetof (struct inode_disk, data) + offset, bytes_read);
+        }
+      size = 0;
+    }
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
+      lock_acquire (&inode->map_lock);
       disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      lock_release (&inode->map_lock);
       if (sector_idx == -1)
         break;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
@@ -319,11 +540,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      struct cache_entry *entry = cache_get_sector(sector_idx, false);
-      if (entry == NULL)
-        entry = cache_fetch_sector(sector_idx, false);
-      ASSERT(entry != NULL);
-      memcpy(buffer + bytes_read, entry->payload + sector_ofs, chunk_size);
+      if (sector_idx == 0 || (sector_idx & SECTOR_UNWRITTEN))
+        memset(buffer + bytes_read, 0, chunk_size);
+      else
+        cache_read(sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       /*
       if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
         {
@@ -350,11 +570,37 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  rwlock_release_read (&inode->rwlock);
   //free (bounce);
 
   return bytes_read;
 }
 
+/* Queues the sectors of INODE that hold bytes START through END - 1
+   for read-ahead, stopping at end of file. */
+void
+inode_read_ahead (struct inode *inode, off_t start, off_t end)
+{
+  off_t pos;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (inode->inline_data)
+    end = 0;
+  else if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (pos = start - start % DISK_SECTOR_SIZE; pos < end; pos += DISK_SECTOR_SIZE)
+    {
+      lock_acquire (&inode->map_lock);
+      disk_sector_t sector_idx = byte_to_sector (inode, pos);
+      lock_release (&inode->map_lock);
+      if (sector_idx == (disk_sector_t) -1)
+        break;
+      if (sector_idx != 0 && !(sector_idx & SECTOR_UNWRITTEN))
+        cache_read_ahead (sector_idx);
+    }
+  rwlock_release_read (&inode->rwlock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -368,12 +614,37 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   off_t bytes_written = 0;
   //uint8_t *bounce = NULL;
 
+  rwlock_acquire_write (&inode->rwlock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rwlock);
+      return 0;
+    }
   //printf("write: inode, inode length, size, offset %p %d %d %d \n", inode, inode->data.length, size, offset);
+  if (inode->inline_data){
+    if (offset + size <= INLINE_DATA_MAX){
+      // The bytes between the old end and OFFSET are already zero
+      cache_write(inode->sector, buffer, offsetof(struct inode_disk, data) + offset, size);
+      if (offset + size > inode->length){
+        inode->length = offset + size;
+        inode->dirty = true;
+      }
+      rwlock_release_write (&inode->rwlock);
+      return size;
+    }
+    inode->dirty = true;
+    if (!inode_promote(inode)){
+      rwlock_release_write (&inode->rwlock);
+      return 0;
+    }
+  }
   if (offset + size > inode_length(inode)){
     //printf("write: calling expand\n");
-    if (inode_expand(inode, offset+size))
+    inode->dirty = true;
+    // Only the bytes written get sectors, a gap before them is a hole
+    bool expanded = inode->extent_based ? inode_expand_extents(inode, offset, offset+size)
+                                        : inode_expand(inode, offset, offset+size);
+    if (expanded)
       inode->length = offset+size;
   }
 
@@ -394,11 +665,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      struct cache_entry *entry = cache_get_sector(sector_idx, true);
-      if (entry == NULL)
-        entry = cache_fetch_sector(sector_idx, true);
-      ASSERT(entry != NULL);
-      memcpy (entry->payload + sector_ofs, buffer + bytes_written, chunk_size);
+      if (sector_idx == 0 || (sector_idx & SECTOR_UNWRITTEN)){
+        // First write: whatever the chunk does not cover must read as zeros
+        sector_idx = inode_prepare_write(inode, offset);
+        inode->dirty = true;
+        if (sector_idx == (disk_sector_t) -1)
+          break;
+        cache_write_new(sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      }
+      else
+        cache_write(sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
       /*
       if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) 
         {
@@ -432,6 +708,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+  rwlock_release_write (&inode->rwlock);
   //free (bounce);
 
   return bytes_written;
@@ -442,8 +719,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -452,9 +731,26 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Acquires the lock that serializes directory operations on
+   INODE: lookups, additions and removals of entries. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock taken by inode_lock(). */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -464,126 +760,656 @@ inode_length (const struct inode *inode)
   return inode->length;
 }
 
+/* Releases the data and index blocks of INODE.  Holes have nothing
+   to release. */
 static void inode_free_resources(struct inode *inode){
-  size_t sectors = bytes_to_sectors(inode->length);
-  if (sectors){
-    int i = 0;
-    while (i < DIRECT_BLOCKS && sectors > 0){
-      free_map_release(inode->blocks[i], 1);
-      i++;
-      sectors--;
-    }
-  }
+  disk_sector_t block[NUM_DIRECT_PTRS];
+  int i;
+  for (i = 0; i < DIRECT_BLOCKS; i++)
+    if (inode->blocks[i] != 0)
+      free_map_release(inode->blocks[i] & ~SECTOR_UNWRITTEN, 1);
 
-  if (sectors){
-    int i = 0;
-    disk_sector_t block[NUM_DIRECT_PTRS];
-    disk_read(filesys_disk, inode->blocks[12], &block);
-    while(i < 128 && sectors > 0){
-      free_map_release(block[i], 1);
-      i++;
-      sectors--;
-    }
+  if (inode->blocks[12] != 0){
+    cache_read(inode->blocks[12], &block, 0, DISK_SECTOR_SIZE);
+    for (i = 0; i < NUM_DIRECT_PTRS; i++)
+      if (block[i] != 0)
+        free_map_release(block[i] & ~SECTOR_UNWRITTEN, 1);
+    free_map_release(inode->blocks[12], 1);
   }
 
-  if (sectors){
-    int block_index = 0;
+  if (inode->blocks[13] != 0){
     disk_sector_t block_ptrs[NUM_DIRECT_PTRS];
-    disk_read(filesys_disk, inode->blocks[13], &block_ptrs);
-    while (block_index < 128 && sectors > 0){
-      disk_sector_t block[NUM_DIRECT_PTRS];
-      disk_read(filesys_disk, block_ptrs[block_index], &block);
-      int i = 0;
-      while (i < 128 && sectors > 0){
-        free_map_release(block[i], 1);
-        i++;
-        sectors--;
-      }
-      block_index++;
+    int block_index;
+    cache_read(inode->blocks[13], &block_ptrs, 0, DISK_SECTOR_SIZE);
+    for (block_index = 0; block_index < NUM_DIRECT_PTRS; block_index++){
+      if (block_ptrs[block_index] == 0)
+        continue;
+      cache_read(block_ptrs[block_index], &block, 0, DISK_SECTOR_SIZE);
+      for (i = 0; i < NUM_DIRECT_PTRS; i++)
+        if (block[i] != 0)
+          free_map_release(block[i] & ~SECTOR_UNWRITTEN, 1);
+      free_map_release(block_ptrs[block_index], 1);
     }
+    free_map_release(inode->blocks[13], 1);
   }
 }
 
-static bool inode_expand(struct inode *inode, off_t new_length){
-  static char zeros[DISK_SECTOR_SIZE];
-  size_t extra_sectors = bytes_to_sectors(new_length) - bytes_to_sectors(inode->length);
-  if (extra_sectors == 0)
+/* Allocates CNT consecutive sectors for INODE into *SECTOR, looking
+   first right after the last sectors it was given, or after INODE
+   itself for its first allocation. */
+static bool inode_allocate(struct inode *inode, size_t cnt, disk_sector_t *sector){
+  if (!free_map_allocate_near(inode->next_alloc, cnt, sector))
+    return false;
+  inode->next_alloc = *sector + cnt;
+  return true;
+}
+
+/* Allocates a zeroed index block of INODE into *SECTOR. */
+static bool index_block_new(struct inode *inode, disk_sector_t *sector){
+  if (!inode_allocate(inode, 1, sector))
+    return false;
+  cache_write_new(*sector, NULL, 0, 0);
+  return true;
+}
+
+/* Finds the block table entry that maps file sector IDX of INODE:
+   entry *SLOT of index block *TABLE, or of INODE->blocks if *TABLE is
+   0.  Missing index blocks are allocated if ALLOCATE, otherwise IDX
+   lies in a hole and false is returned. */
+static bool index_slot(struct inode *inode, uint32_t idx, bool allocate, disk_sector_t *table, uint32_t *slot){
+  if (idx < DIRECT_BLOCKS){
+    *table = 0;
+    *slot = idx;
     return true;
-  
-  while (inode->direct < 12){
-    // Use all direct blocks first
-    if (!free_map_allocate(1, &inode->blocks[inode->direct]))
+  }
+  idx-=DIRECT_BLOCKS;
+  if (idx < NUM_DIRECT_PTRS){
+    if (inode->blocks[12] == 0 && (!allocate || !index_block_new(inode, &inode->blocks[12])))
       return false;
-    //printf("expand: sector num given %d\n", inode->blocks[inode->direct]);
-    disk_write(filesys_disk, inode->blocks[inode->direct], zeros);
-    inode->direct++;
-    extra_sectors--;
-    if (extra_sectors == 0)
-      return true;
+    *table = inode->blocks[12];
+    *slot = idx;
+    return true;
+  }
+  idx-=NUM_DIRECT_PTRS;
+  ASSERT(idx < NUM_DIRECT_PTRS*NUM_DIRECT_PTRS);
+  if (inode->blocks[13] == 0 && (!allocate || !index_block_new(inode, &inode->blocks[13])))
+    return false;
+  int block_index = idx/NUM_DIRECT_PTRS;
+  if (inode->memo_index != block_index){
+    // Remember the second-level block, sequential access stays in it
+    cache_read(inode->blocks[13], &inode->memo_sector,
+               block_index*sizeof *table, sizeof *table);
+    inode->memo_index = block_index;
+  }
+  if (inode->memo_sector == 0){
+    if (!allocate || !index_block_new(inode, &inode->memo_sector))
+      return false;
+    cache_write(inode->blocks[13], &inode->memo_sector,
+                block_index*sizeof *table, sizeof *table);
+  }
+  *table = inode->memo_sector;
+  *slot = idx%NUM_DIRECT_PTRS;
+  return true;
+}
+
+/* Returns the block table entry found by index_slot(). */
+static disk_sector_t index_get(struct inode *inode, disk_sector_t table, uint32_t slot){
+  disk_sector_t sector;
+  if (table == 0)
+    return inode->blocks[slot];
+  cache_read(table, &sector, slot*sizeof sector, sizeof sector);
+  return sector;
+}
+
+/* Overwrites the block table entry found by index_slot(). */
+static void index_set(struct inode *inode, disk_sector_t table, uint32_t slot, disk_sector_t sector){
+  if (table == 0)
+    inode->blocks[slot] = sector;
+  else
+    cache_write(table, &sector, slot*sizeof sector, sizeof sector);
+}
+
+/* Allocates sectors for bytes START through NEW_LENGTH - 1 of INODE
+   that lie past its end.  The new sectors are marked unwritten
+   instead of being zeroed, and any gap between the old end and
+   START is left as a hole. */
+static bool inode_expand(struct inode *inode, off_t start, off_t new_length){
+  uint32_t idx = bytes_to_sectors(inode->length);
+  uint32_t end = bytes_to_sectors(new_length);
+  if (idx < (uint32_t) start/DISK_SECTOR_SIZE)
+    idx = (uint32_t) start/DISK_SECTOR_SIZE;
+  if (end > MAX_BLOCKS)
+    return false;
+
+  uint32_t first = idx;
+  for (; idx < end; idx++){
+    disk_sector_t table, sector;
+    uint32_t slot;
+    if (!index_slot(inode, idx, true, &table, &slot)
+        || !inode_allocate(inode, 1, &sector)){
+      // Give back what this call took, index blocks included, so that
+      // no entry past the end of the file ever points at a sector
+      uint32_t last = idx;
+      while (idx-- > first){
+        index_slot(inode, idx, false, &table, &slot);
+        free_map_release(index_get(inode, table, slot) & ~SECTOR_UNWRITTEN, 1);
+        index_set(inode, table, slot, 0);
+      }
+      index_release_empty(inode, first, last);
+      return false;
+    }
+    index_set(inode, table, slot, sector | SECTOR_UNWRITTEN);
   }
+  return true;
+}
 
-  if(inode->indirect < 128){
-    // If no direct blocks, start using indirect blocks
-    disk_sector_t block[NUM_DIRECT_PTRS];
-    if (inode->indirect > 0)
-      disk_read(filesys_disk, inode->blocks[12], &block); // blocks[12] holds array of direct pointers
-    else if (!free_map_allocate(1, &inode->blocks[12]))
+/* Returns true if no entry of index block SECTOR is set. */
+static bool index_block_empty(disk_sector_t sector){
+  disk_sector_t block[NUM_DIRECT_PTRS];
+  int i;
+  cache_read(sector, block, 0, DISK_SECTOR_SIZE);
+  for (i = 0; i < NUM_DIRECT_PTRS; i++)
+    if (block[i] != 0)
       return false;
-    
-    while(inode->indirect < 128){
-      if (!free_map_allocate(1, &block[inode->indirect]))
+  return true;
+}
+
+/* Releases the index blocks of INODE that map file sectors FIRST
+   through LAST, yet have no entries set.  An empty index block maps
+   nothing but holes, so dropping it changes no data. */
+static void index_release_empty(struct inode *inode, uint32_t first, uint32_t last){
+  uint32_t base = DIRECT_BLOCKS + NUM_DIRECT_PTRS;
+
+  if (first < base && last >= DIRECT_BLOCKS && inode->blocks[12] != 0
+      && index_block_empty(inode->blocks[12])){
+    free_map_release(inode->blocks[12], 1);
+    inode->blocks[12] = 0;
+  }
+
+  if (last >= base && inode->blocks[13] != 0){
+    uint32_t b = first > base ? (first - base) / NUM_DIRECT_PTRS : 0;
+    for (; b <= (last - base) / NUM_DIRECT_PTRS; b++){
+      disk_sector_t table;
+      cache_read(inode->blocks[13], &table, b * sizeof table, sizeof table);
+      if (table == 0 || !index_block_empty(table))
+        continue;
+      free_map_release(table, 1);
+      table = 0;
+      cache_write(inode->blocks[13], &table, b * sizeof table, sizeof table);
+    }
+    if (index_block_empty(inode->blocks[13])){
+      free_map_release(inode->blocks[13], 1);
+      inode->blocks[13] = 0;
+    }
+  }
+  // The memo may name a released second-level block
+  inode->memo_index = -1;
+}
+
+/* Zeroes entries FIRST onward of index block SECTOR, writing it back
+   only if any of them was set. */
+static void index_block_scrub(disk_sector_t sector, uint32_t first){
+  disk_sector_t block[NUM_DIRECT_PTRS];
+  uint32_t i;
+  cache_read(sector, block, 0, DISK_SECTOR_SIZE);
+  for (i = first; i < NUM_DIRECT_PTRS; i++)
+    if (block[i] != 0)
+      break;
+  if (i == NUM_DIRECT_PTRS)
+    return;
+  memset(block + first, 0, (NUM_DIRECT_PTRS - first) * sizeof *block);
+  cache_write(sector, block + first, first * sizeof *block,
+              (NUM_DIRECT_PTRS - first) * sizeof *block);
+}
+
+/* Clears the block table entries of INODE that lie past its end.
+   Block table inodes written before holes existed were built from
+   uninitialized memory, so those entries, index block pointers
+   included, may hold anything, and a nonzero entry now means an
+   allocated sector to inode_expand() and inode_free_resources().
+   Only index blocks that the length proves are real are read.  The
+   inode is written back in the current format, so this is done only
+   once per inode. */
+static void index_scrub(struct inode *inode){
+  uint32_t cnt = bytes_to_sectors(inode->length);
+  uint32_t i;
+
+  for (i = cnt; i < DIRECT_BLOCKS; i++)
+    inode->blocks[i] = 0;
+
+  if (cnt <= DIRECT_BLOCKS)
+    inode->blocks[12] = 0;
+  else if (cnt < DIRECT_BLOCKS + NUM_DIRECT_PTRS && inode->blocks[12] != 0)
+    index_block_scrub(inode->blocks[12], cnt - DIRECT_BLOCKS);
+
+  if (cnt <= DIRECT_BLOCKS + NUM_DIRECT_PTRS)
+    inode->blocks[13] = 0;
+  else if (inode->blocks[13] != 0){
+    uint32_t used = cnt - DIRECT_BLOCKS - NUM_DIRECT_PTRS;
+    uint32_t tables = DIV_ROUND_UP(used, NUM_DIRECT_PTRS);
+    if (used % NUM_DIRECT_PTRS != 0){
+      disk_sector_t table;
+      cache_read(inode->blocks[13], &table, (tables - 1) * sizeof table,
+                 sizeof table);
+      if (table != 0)
+        index_block_scrub(table, used % NUM_DIRECT_PTRS);
+    }
+    if (tables < NUM_DIRECT_PTRS)
+      index_block_scrub(inode->blocks[13], tables);
+  }
+  inode->dirty = true;
+}
+
+/* Resets the lookup memos of INODE. */
+static void inode_init_mapping(struct inode *inode){
+  inode->memo_index = -1;
+  inode->memo_extent = 0;
+  inode->memo_extent_first = 0;
+}
+
+static void inode_from_disk(struct inode *inode, const struct inode_disk *disk_inode){
+  inode->length = disk_inode->length;
+  inode->isFile = disk_inode->isFile;
+  inode->parent_sector = disk_inode->parent_sector;
+  memcpy(inode->blocks, disk_inode->blocks, 14*sizeof(disk_sector_t));
+  inode->inline_data = disk_inode->magic == INODE_INLINE_MAGIC;
+  inode->extent_based = disk_inode->magic == INODE_EXTENT_MAGIC;
+  if (inode->inline_data){
+    // The extent fields hold data, and the layout is picked on promotion
+    inode->extent_cnt = inode->extent_sectors = inode->extent_block = 0;
+    return;
+  }
+  inode->extent_cnt = disk_inode->extent_cnt;
+  inode->extent_sectors = disk_inode->extent_sectors;
+  inode->extent_block = disk_inode->extent_block;
+  memcpy(inode->extents, disk_inode->extents, sizeof inode->extents);
+}
+
+static void inode_to_disk(const struct inode *inode, struct inode_disk *disk_inode){
+  memset(disk_inode, 0, sizeof *disk_inode);
+  disk_inode->length = inode->length;
+  disk_inode->magic = inode->inline_data ? INODE_INLINE_MAGIC
+                      : inode->extent_based ? INODE_EXTENT_MAGIC : INODE_TABLE_MAGIC;
+  memcpy(disk_inode->blocks, inode->blocks, 14*sizeof(disk_sector_t));
+  disk_inode->isFile = inode->isFile;
+  disk_inode->parent_sector = inode->parent_sector;
+  disk_inode->extent_cnt = inode->extent_cnt;
+  disk_inode->extent_sectors = inode->extent_sectors;
+  disk_inode->extent_block = inode->extent_block;
+  memcpy(disk_inode->extents, inode->extents, sizeof disk_inode->extents);
+}
+
+/* Moves the inline data of INODE out to a data sector, in the layout
+   that new inodes use, so that it can grow past INLINE_DATA_MAX
+   bytes.  Returns false, leaving INODE inline, if no sector is left. */
+static bool inode_promote(struct inode *inode){
+  uint8_t data[INLINE_DATA_MAX];
+  off_t length = inode->length;
+  bool success;
+
+  cache_read(inode->sector, data, offsetof(struct inode_disk, data), length);
+  inode->inline_data = false;
+  inode->extent_based = use_extents;
+  inode->length = 0;
+  memset(inode->blocks, 0, sizeof inode->blocks);
+  inode_init_mapping(inode);
+  success = inode->extent_based ? inode_expand_extents(inode, 0, length)
+                                : inode_expand(inode, 0, length);
+  if (success){
+    inode->length = length;
+    if (length > 0){
+      disk_sector_t sector = inode_prepare_write(inode, 0);
+      success = sector != (disk_sector_t) -1;
+      if (success)
+        cache_write_new(sector, data, 0, length);
+    }
+  }
+  if (!success){
+    if (inode->extent_based)
+      inode_free_extents(inode);
+    else
+      inode_free_resources(inode);
+    memset(inode->blocks, 0, sizeof inode->blocks);
+    inode->extent_cnt = inode->extent_sectors = inode->extent_block = 0;
+    inode_init_mapping(inode);
+    inode->inline_data = true;
+    inode->length = length;
+  }
+  return success;
+}
+
+/* Returns the overflow block holding extent I (I >= INLINE_EXTENTS)
+   of INODE and stores the index of the extent in it into *SLOT. */
+static disk_sector_t extent_block_of(const struct inode *inode, uint32_t i, uint32_t *slot){
+  disk_sector_t block = inode->extent_block;
+  i -= INLINE_EXTENTS;
+  while (i >= OVERFLOW_EXTENTS){
+    cache_read(block, &block, offsetof(struct extent_block, next), sizeof block);
+    i -= OVERFLOW_EXTENTS;
+  }
+  *slot = i;
+  return block;
+}
+
+/* Stores extent I of INODE into *EXT. */
+static void extent_get(const struct inode *inode, uint32_t i, struct extent *ext){
+  ASSERT(i < inode->extent_cnt);
+  if (i < INLINE_EXTENTS)
+    *ext = inode->extents[i];
+  else{
+    uint32_t slot;
+    disk_sector_t block = extent_block_of(inode, i, &slot);
+    cache_read(block, ext, offsetof(struct extent_block, extents) + slot*sizeof *ext, sizeof *ext);
+  }
+}
+
+/* Overwrites extent I of INODE with EXT. */
+static void extent_set(struct inode *inode, uint32_t i, const struct extent *ext){
+  ASSERT(i < inode->extent_cnt);
+  if (i < INLINE_EXTENTS)
+    inode->extents[i] = *ext;
+  else{
+    uint32_t slot;
+    disk_sector_t block = extent_block_of(inode, i, &slot);
+    cache_write(block, ext, offsetof(struct extent_block, extents) + slot*sizeof *ext, sizeof *ext);
+  }
+}
+
+/* Makes room for one more extent at the end of INODE's extents,
+   chaining a new overflow block if the last one is full.  Returns
+   false if no sector is left for the overflow block. */
+static bool extent_grow(struct inode *inode){
+  uint32_t i = inode->extent_cnt;
+  if (i >= INLINE_EXTENTS && (i - INLINE_EXTENTS) % OVERFLOW_EXTENTS == 0){
+    static struct extent_block empty;
+    disk_sector_t link;
+    disk_sector_t prev = 0;
+    uint32_t slot;
+
+    // Extents may have been removed since, leaving the block in place
+    if (i == INLINE_EXTENTS)
+      link = inode->extent_block;
+    else{
+      prev = extent_block_of(inode, i - 1, &slot);
+      cache_read(prev, &link, offsetof(struct extent_block, next), sizeof link);
+    }
+    if (link == 0){
+      if (!inode_allocate(inode, 1, &link))
         return false;
-      disk_write(filesys_disk, block[inode->indirect], zeros);
-      inode->indirect++;
-      extra_sectors--;
-      if (extra_sectors == 0)
-        break;
+      cache_write(link, &empty, 0, DISK_SECTOR_SIZE);
+      if (i == INLINE_EXTENTS)
+        inode->extent_block = link;
+      else
+        cache_write(prev, &link, offsetof(struct extent_block, next), sizeof link);
     }
-    disk_write(filesys_disk, inode->blocks[12], &block);
-    if (extra_sectors == 0)
+  }
+  inode->extent_cnt++;
+  return true;
+}
+
+/* Adds the run of LENGTH sectors at START as the last extent of
+   INODE.  Returns false if no sector is left for an overflow block. */
+static bool extent_append(struct inode *inode, disk_sector_t start, uint32_t length, bool unwritten){
+  struct extent ext;
+  ext.start = start;
+  ext.length = length;
+  ext.unwritten = unwritten;
+  if (!extent_grow(inode))
+    return false;
+  extent_set(inode, inode->extent_cnt - 1, &ext);
+  inode->extent_sectors += length;
+  return true;
+}
+
+/* Inserts EXT as extent I of INODE, shifting the following ones. */
+static bool extent_insert(struct inode *inode, uint32_t i, const struct extent *ext){
+  uint32_t j;
+  struct extent tmp;
+  if (!extent_grow(inode))
+    return false;
+  for (j = inode->extent_cnt - 1; j > i; j--){
+    extent_get(inode, j - 1, &tmp);
+    extent_set(inode, j, &tmp);
+  }
+  extent_set(inode, i, ext);
+  inode_init_mapping(inode);
+  return true;
+}
+
+/* Removes extent I of INODE, shifting the following ones. */
+static void extent_remove(struct inode *inode, uint32_t i){
+  struct extent tmp;
+  for (; i + 1 < inode->extent_cnt; i++){
+    extent_get(inode, i + 1, &tmp);
+    extent_set(inode, i, &tmp);
+  }
+  inode->extent_cnt--;
+  inode_init_mapping(inode);
+}
+
+/* Finds the extent of INODE that maps file sector IDX, resuming from
+   the extent the previous lookup ended in.  Stores its index into
+   *IP, the first file sector it maps into *FIRSTP and the extent
+   into *EXT.  Returns false if no extent maps IDX. */
+static bool extent_find(struct inode *inode, uint32_t idx, uint32_t *ip, uint32_t *firstp, struct extent *ext){
+  uint32_t i = 0, first = 0;
+  if (idx >= inode->memo_extent_first){
+    i = inode->memo_extent;
+    first = inode->memo_extent_first;
+  }
+  for (; i < inode->extent_cnt; i++){
+    extent_get(inode, i, ext);
+    if (idx < first + ext->length){
+      inode->memo_extent = i;
+      inode->memo_extent_first = first;
+      *ip = i;
+      *firstp = first;
       return true;
+    }
+    first += ext->length;
   }
+  return false;
+}
 
-  if (inode->double_indirect < 128*128){
-    // If no indirect blocks, start using double indirect blocks
+/* Makes the sector holding byte POS of INODE, which must be a hole
+   or unwritten, a written one and returns it.  A hole gets a sector
+   allocated here.  Returns -1 if the disk is full. */
+static disk_sector_t inode_prepare_write(struct inode *inode, off_t pos){
+  uint32_t idx = pos/DISK_SECTOR_SIZE;
+  disk_sector_t table, entry;
+  uint32_t slot;
 
-    disk_sector_t block_ptrs[NUM_DIRECT_PTRS];
-    if (inode->double_indirect > 0)
-      disk_read(filesys_disk, inode->blocks[13], &block_ptrs);
-    else if (!free_map_allocate(1, &inode->blocks[13]))
-      return false;
+  if (inode->extent_based){
+    uint32_t i, first;
+    struct extent ext, before, mid, after, tmp;
+    bool found = extent_find(inode, idx, &i, &first, &ext);
+    bool hole = ext.start == 0;
+    ASSERT(found && ext.unwritten);
+
+    // Split into BEFORE, written MID (the sector) and AFTER, which
+    // stay as EXT was
+    uint32_t k = idx - first;
+    before = ext;
+    before.length = k;
+    mid.start = ext.start + k;
+    mid.length = 1;
+    mid.unwritten = false;
+    after = ext;
+    after.start = hole ? 0 : ext.start + k + 1;
+    after.length = ext.length - k - 1;
 
-    while(inode->double_indirect < 128*128){
-      uint32_t block_index = inode->double_indirect/128;
-      disk_sector_t block[NUM_DIRECT_PTRS];
-      if (inode->double_indirect%128 == 0){
-        if (!free_map_allocate(1, &block_ptrs[block_index]))
-          return false;
+    if (hole){
+      // Try to place the sector right next to a written neighbour
+      bool placed = false;
+      if (k == 0 && i > 0){
+        extent_get(inode, i - 1, &tmp);
+        if (!tmp.unwritten && free_map_extend(tmp.start + tmp.length, 1) == 1){
+          mid.start = tmp.start + tmp.length;
+          placed = true;
+        }
       }
-      else
-        disk_read(filesys_disk, block_ptrs[block_index], &block);
-
-      uint32_t index = inode->double_indirect%128;
-      while (index < 128){
-        if (!free_map_allocate(1, &block[index]))
-          return false;
-        disk_write(filesys_disk, block[index], zeros);
-        inode->double_indirect++;
-        extra_sectors--;
-        index++;
-        if (extra_sectors == 0)
-          break;
+      if (!placed && after.length == 0 && i + 1 < inode->extent_cnt){
+        extent_get(inode, i + 1, &tmp);
+        if (!tmp.unwritten && tmp.start > 1 && free_map_extend(tmp.start - 1, 1) == 1){
+          mid.start = tmp.start - 1;
+          placed = true;
+        }
       }
-      disk_write(filesys_disk, block_ptrs[block_index], &block);
-      if (extra_sectors == 0)
-        break;
+      if (!placed && !inode_allocate(inode, 1, &mid.start))
+        return -1;
     }
 
-    disk_write(filesys_disk, inode->blocks[13], &block_ptrs);
-    if (extra_sectors == 0)
-      return true;
+    // Sequential writers just move the boundary with a written neighbour
+    if (k == 0 && i > 0){
+      extent_get(inode, i - 1, &tmp);
+      if (!tmp.unwritten && tmp.start + tmp.length == mid.start){
+        tmp.length++;
+        extent_set(inode, i - 1, &tmp);
+        if (after.length > 0){
+          extent_set(inode, i, &after);
+          inode->memo_extent_first++;
+        }
+        else
+          extent_remove(inode, i);
+        return mid.start;
+      }
+    }
+    if (after.length == 0 && i + 1 < inode->extent_cnt){
+      extent_get(inode, i + 1, &tmp);
+      if (!tmp.unwritten && mid.start + 1 == tmp.start){
+        tmp.start--;
+        tmp.length++;
+        extent_set(inode, i + 1, &tmp);
+        if (before.length > 0)
+          extent_set(inode, i, &before);
+        else
+          extent_remove(inode, i);
+        inode_init_mapping(inode);
+        return mid.start;
+      }
+    }
+
+    // Otherwise split.  If no overflow block can be had, a hole fails
+    // the write and an unwritten extent is zeroed in one piece instead
+    if (before.length > 0){
+      extent_set(inode, i, &before);
+      if (!extent_insert(inode, ++i, &mid)){
+        if (hole){
+          extent_set(inode, i - 1, &ext);
+          free_map_release(mid.start, 1);
+          return -1;
+        }
+        uint32_t j;
+        for (j = 0; j < ext.length; j++)
+          cache_write_new(ext.start + j, NULL, 0, 0);
+        ext.unwritten = false;
+        extent_set(inode, i - 1, &ext);
+        return mid.start;
+      }
+    }
+    else
+      extent_set(inode, i, &mid);
+    if (after.length > 0 && !extent_insert(inode, i + 1, &after)){
+      if (hole){
+        // Give the sector back, leaving one hole as before
+        if (before.length > 0)
+          extent_remove(inode, i);
+        extent_set(inode, i - (before.length > 0), &ext);
+        free_map_release(mid.start, 1);
+        return -1;
+      }
+      // Keep AFTER's sectors mapped by growing MID over them
+      mid.length += after.length;
+      extent_set(inode, i, &mid);
+      uint32_t j;
+      for (j = 1; j <= after.length; j++)
+        cache_write_new(mid.start + j, NULL, 0, 0);
+    }
+    inode_init_mapping(inode);
+    return mid.start;
+  }
+
+  if (!index_slot(inode, idx, true, &table, &slot))
+    return -1;
+  entry = index_get(inode, table, slot);
+  if (entry == 0 && !inode_allocate(inode, 1, &entry))
+    return -1;
+  entry &= ~SECTOR_UNWRITTEN;
+  index_set(inode, table, slot, entry);
+  return entry;
+}
+
+/* Grows the extents of INODE to cover NEW_LENGTH bytes, with a hole
+   extent for the sectors before the one holding byte START.  The
+   last extent is extended in place while the sectors after it are
+   free; otherwise the largest free run that fits, up to what is
+   still needed, becomes a new extent.  New sectors are not zeroed
+   but go into unwritten extents. */
+static bool inode_expand_extents(struct inode *inode, off_t start, off_t new_length){
+  size_t needed = bytes_to_sectors(new_length);
+  size_t first = start/DISK_SECTOR_SIZE;
+
+  if (first > inode->extent_sectors && first < needed){
+    uint32_t gap = first - inode->extent_sectors;
+    struct extent last;
+    if (inode->extent_cnt > 0)
+      extent_get(inode, inode->extent_cnt - 1, &last);
+    if (inode->extent_cnt > 0 && last.start == 0){
+      last.length += gap;
+      extent_set(inode, inode->extent_cnt - 1, &last);
+      inode->extent_sectors += gap;
+    }
+    else if (!extent_append(inode, 0, gap, true))
+      return false;
+  }
+
+  while (inode->extent_sectors < needed){
+    size_t want = needed - inode->extent_sectors;
+    disk_sector_t sector;
+    size_t got = 0;
+
+    if (inode->extent_cnt > 0){
+      struct extent last;
+      extent_get(inode, inode->extent_cnt - 1, &last);
+      if (last.start != 0 && last.unwritten)
+        got = free_map_extend(last.start + last.length, want);
+      if (got > 0){
+        last.length += got;
+        extent_set(inode, inode->extent_cnt - 1, &last);
+        inode->extent_sectors += got;
+        continue;
+      }
+    }
+    got = want;
+    while (got > 0 && !inode_allocate(inode, got, &sector))
+      got /= 2;
+    if (got == 0)
+      return false;
+    if (!extent_append(inode, sector, got, true)){
+      free_map_release(sector, got);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Releases the data and overflow blocks of extent based INODE. */
+static void inode_free_extents(struct inode *inode){
+  uint32_t i;
+  for (i = 0; i < inode->extent_cnt; i++){
+    struct extent ext;
+    extent_get(inode, i, &ext);
+    if (ext.start != 0)
+      free_map_release(ext.start, ext.length);
+  }
+
+  disk_sector_t block = inode->extent_block;
+  while (block != 0){
+    disk_sector_t next;
+    cache_read(block, &next, offsetof(struct extent_block, next), sizeof next);
+    free_map_release(block, 1);
+    block = next;
   }
-  return false;
 }
 
 bool inode_is_file(struct inode *inode){
@@ -603,6 +1429,23 @@ bool inode_make_parent(disk_sector_t parent_sector, disk_sector_t child_sector){
   if (inode == NULL)
     return false;
   inode->parent_sector = parent_sector;
+  inode->dirty = true;
   inode_close(inode);
   return true;
-}
\ No newline at end of file
+}
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int ((int) inode->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  const struct inode *inode_a = hash_entry (a, struct inode, elem);
+  const struct inode *inode_b = hash_entry (b, struct inode, elem);
+  return inode_a->sector < inode_b->sector;
+}
@@ -2,6 +2,7 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
 #include <list.h>
@@ -10,16 +11,22 @@
 struct bitmap;
 
 void inode_init (void);
+void inode_set_extents (bool);
+bool inode_is_extent_based (disk_sector_t);
 bool inode_create (disk_sector_t sector, off_t length, bool isFile);
 struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
+size_t inode_count_open (void);
 disk_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, off_t start, off_t end);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
 off_t inode_length (const struct inode *);
 
 bool inode_make_parent(disk_sector_t parent_sector, disk_sector_t child_sector);
@@ -27,6 +27,7 @@ typedef unsigned long elem_type;
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
+    size_t next_fit;    /* Where bitmap_scan_and_flip_next() starts. */
     elem_type *bits;    /* Elements that represent bits. */
   };
 
@@ -68,6 +69,51 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns element IDX of B's bits, inverted if VALUE is false,
+   so that the bits set to VALUE read as 1. */
+static inline elem_type
+elem_matching (const struct bitmap *b, size_t idx, bool value) 
+{
+  return value ? b->bits[idx] : ~b->bits[idx];
+}
+
+/* Returns the number of 1 bits in BITS. */
+static inline size_t
+elem_popcount (elem_type bits) 
+{
+  size_t cnt;
+
+  if (bits == (elem_type) -1)
+    return ELEM_BITS;
+  for (cnt = 0; bits != 0; cnt++)
+    bits &= bits - 1;
+  return cnt;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or the number of bits in B if there is none.
+   Elements without such a bit are skipped whole, and the bit
+   within an element is found with a single bsf. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) 
+{
+  size_t idx = elem_idx (start);
+  size_t last = elem_cnt (b->bit_cnt);
+  elem_type bits;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+  bits = elem_matching (b, idx, value) & ~(bit_mask (start) - 1);
+  while (bits == 0)
+    {
+      if (++idx >= last)
+        return b->bit_cnt;
+      bits = elem_matching (b, idx, value);
+    }
+  start = idx * ELEM_BITS + __builtin_ctzl (bits);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
 
 /* Creation and destruction. */
 
@@ -82,6 +128,7 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
+      b->next_fit = 0;
       b->bits = malloc (byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
@@ -104,6 +151,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
+  b->next_fit = 0;
   b->bits = (elem_type *) (b + 1);
   bitmap_set_all (b, false);
   return b;
@@ -214,18 +262,31 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, one element at a time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = (n < ELEM_BITS ? ((elem_type) 1 << n) - 1 : (elem_type) -1) << ofs;
+
+      /* See bitmap_mark() and bitmap_reset(). */
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +294,24 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      size_t ofs = start % ELEM_BITS;
+      size_t n = end - start < ELEM_BITS - ofs ? end - start : ELEM_BITS - ofs;
+      elem_type mask = (n < ELEM_BITS ? ((elem_type) 1 << n) - 1 : (elem_type) -1) << ofs;
+
+      value_cnt += elem_popcount (elem_matching (b, idx, value) & mask);
+      start += n;
+    }
   return value_cnt;
 }
 
@@ -251,16 +320,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -299,13 +363,21 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = find_next (b, start, value);
+      while (i <= last)
+        {
+          /* Each run of VALUE bits is measured once, then skipped
+             along with the !VALUE bits that end it. */
+          size_t end = find_next (b, i, !value);
+          if (end - i >= cnt)
+            return i;
+          i = find_next (b, end, value);
+        }
     }
   return BITMAP_ERROR;
 }
@@ -325,6 +397,21 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
+
+/* Like bitmap_scan_and_flip(), but starts at the bit after the
+   group that the previous call on B returned, wrapping around to
+   the beginning of B, so that consecutive calls do not rescan the
+   groups they already flipped. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value)
+{
+  size_t idx = bitmap_scan_and_flip (b, b->next_fit, cnt, value);
+  if (idx == BITMAP_ERROR && b->next_fit > 0)
+    idx = bitmap_scan_and_flip (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    b->next_fit = idx + cnt;
+  return idx;
+}
 
 /* File input and output. */
 
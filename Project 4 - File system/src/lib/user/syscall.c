@@ -182,3 +182,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readdir_bulk (int fd, struct readdir_entry *buf, unsigned size) 
+{
+  return syscall3 (SYS_READDIR_BULK, fd, buf, size);
+}
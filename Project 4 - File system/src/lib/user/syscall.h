@@ -15,6 +15,14 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* A directory entry written by readdir_bulk(). */
+struct readdir_entry
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[READDIR_MAX_LEN + 1];     /* Null-terminated name. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -44,5 +52,6 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int readdir_bulk (int fd, struct readdir_entry *, unsigned size);
 
 #endif /* lib/user/syscall.h */
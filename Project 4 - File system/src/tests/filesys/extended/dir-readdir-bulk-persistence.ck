@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($a) = {"f0" => [''], "f1" => [''], "f2" => [''], "f3" => [''],
+	   "f4" => [''], "sub" => {}};
+check_archive ({"a" => $a});
+pass;
@@ -0,0 +1,99 @@
+/* Reads a directory with readdir_bulk(), mixed with readdir()
+   calls on the same descriptor, and checks that every entry is
+   returned exactly once.  Also checks that readdir_bulk() fails
+   on descriptors that are not open directories. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRY_CNT 6
+
+static const char *names[ENTRY_CNT] = {"f0", "f1", "f2", "f3", "f4", "sub"};
+static int seen[ENTRY_CNT];
+
+/* Records that NAME was returned, failing if it is unknown or was
+   already returned. */
+static void
+see (const char *name)
+{
+  int i;
+
+  for (i = 0; i < ENTRY_CNT; i++)
+    if (!strcmp (name, names[i]))
+      {
+        if (seen[i]++)
+          fail ("\"%s\" returned twice", name);
+        return;
+      }
+  fail ("unexpected entry \"%s\"", name);
+}
+
+/* Checks the records returned by a readdir_bulk() call. */
+static void
+see_records (const struct readdir_entry *r, int cnt, int sub_inumber)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      see (r[i].name);
+      if (r[i].is_dir != !strcmp (r[i].name, "sub"))
+        fail ("wrong type for \"%s\"", r[i].name);
+      if (r[i].is_dir && r[i].inumber != sub_inumber)
+        fail ("wrong inode number for \"sub\"");
+    }
+}
+
+void
+test_main (void) 
+{
+  struct readdir_entry r[ENTRY_CNT + 2];
+  char name[READDIR_MAX_LEN + 1];
+  int fd, file_fd, sub_fd, sub_inumber, cnt, i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (chdir ("a"), "chdir \"a\"");
+  for (i = 0; i < ENTRY_CNT - 1; i++)
+    CHECK (create (names[i], 0), "create \"%s\"", names[i]);
+  CHECK (mkdir ("sub"), "mkdir \"sub\"");
+  CHECK ((sub_fd = open ("sub")) > 1, "open \"sub\"");
+  sub_inumber = inumber (sub_fd);
+  close (sub_fd);
+  CHECK (chdir ("/"), "chdir \"/\"");
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (readdir (fd, name), "readdir \"a\"");
+  see (name);
+
+  cnt = readdir_bulk (fd, r, 3 * sizeof *r);
+  CHECK (cnt == 3, "readdir_bulk \"a\", room for 3 (must return 3, actually %d)",
+         cnt);
+  see_records (r, cnt, sub_inumber);
+
+  CHECK (readdir (fd, name), "readdir \"a\"");
+  see (name);
+
+  cnt = readdir_bulk (fd, r, sizeof r);
+  CHECK (cnt == 1, "readdir_bulk \"a\", room for %d (must return 1, actually %d)",
+         ENTRY_CNT + 2, cnt);
+  see_records (r, cnt, sub_inumber);
+
+  for (i = 0; i < ENTRY_CNT; i++)
+    if (!seen[i])
+      fail ("\"%s\" never returned", names[i]);
+  msg ("every entry returned once");
+
+  cnt = readdir_bulk (fd, r, sizeof r);
+  CHECK (cnt == 0, "readdir_bulk \"a\" at end (must return 0, actually %d)",
+         cnt);
+  CHECK (!readdir (fd, name), "readdir \"a\" at end (must fail)");
+
+  CHECK ((file_fd = open ("a/f0")) > 1, "open \"a/f0\"");
+  cnt = readdir_bulk (file_fd, r, sizeof r);
+  CHECK (cnt == -1, "readdir_bulk \"a/f0\" (must return -1, actually %d)",
+         cnt);
+  cnt = readdir_bulk (1234, r, sizeof r);
+  CHECK (cnt == -1, "readdir_bulk bad fd (must return -1, actually %d)", cnt);
+}
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dir-readdir-bulk) begin
+(dir-readdir-bulk) mkdir "a"
+(dir-readdir-bulk) chdir "a"
+(dir-readdir-bulk) create "f0"
+(dir-readdir-bulk) create "f1"
+(dir-readdir-bulk) create "f2"
+(dir-readdir-bulk) create "f3"
+(dir-readdir-bulk) create "f4"
+(dir-readdir-bulk) mkdir "sub"
+(dir-readdir-bulk) open "sub"
+(dir-readdir-bulk) chdir "/"
+(dir-readdir-bulk) open "a"
+(dir-readdir-bulk) readdir "a"
+(dir-readdir-bulk) readdir_bulk "a", room for 3 (must return 3, actually 3)
+(dir-readdir-bulk) readdir "a"
+(dir-readdir-bulk) readdir_bulk "a", room for 8 (must return 1, actually 1)
+(dir-readdir-bulk) every entry returned once
+(dir-readdir-bulk) readdir_bulk "a" at end (must return 0, actually 0)
+(dir-readdir-bulk) readdir "a" at end (must fail)
+(dir-readdir-bulk) open "a/f0"
+(dir-readdir-bulk) readdir_bulk "a/f0" (must return -1, actually -1)
+(dir-readdir-bulk) readdir_bulk bad fd (must return -1, actually -1)
+(dir-readdir-bulk) end
+dir-readdir-bulk: exit(0)
+EOF
+pass;
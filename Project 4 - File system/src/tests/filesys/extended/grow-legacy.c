@@ -0,0 +1,78 @@
+/* Grows and removes a file whose inode is in the format of the
+   original block table code, which left every block table entry
+   past the end of the file, index block pointers included,
+   uninitialized.
+
+   Run once without arguments, this creates the file.  The test's
+   Makefile rule then rewrites the file's inode with legacy-inode.pl
+   and runs us again with the argument "check". */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Distinct from the length of every other file on the disk, so that
+   legacy-inode.pl can find the inode. */
+#define OLD_SIZE 3333
+
+/* Past the indirect block, into the double indirect one. */
+#define NEW_SIZE 100000
+
+static char buf[NEW_SIZE];
+
+/* Fills the first SIZE bytes of buf with the pattern written to the
+   file, and the rest with zeros. */
+static void
+fill (size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < NEW_SIZE; i++)
+    buf[i] = i < size ? i % 251 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *file_name = "legacy";
+  int fd;
+
+  test_name = argv[0];
+  msg ("begin");
+  fill (OLD_SIZE);
+  if (argc == 1)
+    {
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf, OLD_SIZE) == OLD_SIZE, "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+    }
+  else
+    {
+      CHECK (argc == 2 && !strcmp (argv[1], "check"),
+             "argument must be \"check\"");
+      check_file (file_name, buf, OLD_SIZE);
+
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      msg ("seek \"%s\"", file_name);
+      seek (fd, NEW_SIZE - 1);
+      buf[NEW_SIZE - 1] = 'x';
+      CHECK (write (fd, buf + NEW_SIZE - 1, 1) == 1, "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+      check_file (file_name, buf, NEW_SIZE);
+
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+      file_name = "after";
+      fill (NEW_SIZE);
+      CHECK (create (file_name, NEW_SIZE), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, buf, NEW_SIZE) == NEW_SIZE, "write \"%s\"", file_name);
+      msg ("close \"%s\"", file_name);
+      close (fd);
+      check_file (file_name, buf, NEW_SIZE);
+    }
+  msg ("end");
+  return 0;
+}
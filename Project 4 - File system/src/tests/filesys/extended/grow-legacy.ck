@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(grow-legacy) begin
+(grow-legacy) open "legacy" for verification
+(grow-legacy) verified contents of "legacy"
+(grow-legacy) close "legacy"
+(grow-legacy) open "legacy"
+(grow-legacy) seek "legacy"
+(grow-legacy) write "legacy"
+(grow-legacy) close "legacy"
+(grow-legacy) open "legacy" for verification
+(grow-legacy) verified contents of "legacy"
+(grow-legacy) close "legacy"
+(grow-legacy) remove "legacy"
+(grow-legacy) create "after"
+(grow-legacy) open "after"
+(grow-legacy) write "after"
+(grow-legacy) close "after"
+(grow-legacy) open "after" for verification
+(grow-legacy) verified contents of "after"
+(grow-legacy) close "after"
+(grow-legacy) end
+grow-legacy: exit(0)
+EOF
+pass;
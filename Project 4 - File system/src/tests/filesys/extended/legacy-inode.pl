@@ -0,0 +1,37 @@
+#! /usr/bin/perl
+# Puts the block table inode of the 3333 byte file on the file system
+# disk DISK back in the format of the original block table code: the
+# old magic number, and garbage in every block table entry past the
+# end of the file, index block pointers included.  Used by grow-legacy.
+
+use strict;
+use warnings;
+
+my ($SIZE) = 3333;
+my ($INODE_MAGIC) = 0x494e4f44;
+my ($INODE_TABLE_MAGIC) = 0x494e4f54;
+
+@ARGV == 1 or die "usage: legacy-inode.pl DISK\n";
+my ($disk) = @ARGV;
+open (DISK, '+<', $disk) or die "$disk: open: $!\n";
+binmode (DISK);
+
+my ($found) = 0;
+for (my ($sector) = 0; ; $sector++) {
+    my ($buf);
+    seek (DISK, $sector * 512, 0) or die "$disk: seek: $!\n";
+    last if read (DISK, $buf, 512) != 512;
+
+    my ($length, $magic, @blocks) = unpack ("V V V14", $buf);
+    next if $length != $SIZE || $magic != $INODE_TABLE_MAGIC;
+
+    # The data takes 7 direct blocks; nothing past them is real.
+    $blocks[$_] = 0xcccc0000 + $_ foreach 7...13;
+    substr ($buf, 0, 16 * 4) = pack ("V V V14", $length, $INODE_MAGIC, @blocks);
+    seek (DISK, $sector * 512, 0) or die "$disk: seek: $!\n";
+    print DISK $buf or die "$disk: write: $!\n";
+    $found++;
+}
+close (DISK) or die "$disk: close: $!\n";
+die "$disk: found $found inodes of $SIZE byte files, expected 1\n"
+  if $found != 1;
@@ -338,3 +338,85 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RWLOCK.  A readers-writer lock can be held by any
+   number of readers at once, or by a single writer.  A writer
+   that is waiting blocks readers that arrive after it, so that
+   a steady stream of readers cannot starve writers.
+
+   Like a lock, an rwlock may not be acquired recursively, and
+   it may not be used within an interrupt handler. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_init (&rwlock->lock);
+  cond_init (&rwlock->can_read);
+  cond_init (&rwlock->can_write);
+  rwlock->readers = 0;
+  rwlock->waiting_writers = 0;
+  rwlock->writer = false;
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds or
+   waits for it. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  while (rwlock->writer || rwlock->waiting_writers > 0)
+    cond_wait (&rwlock->can_read, &rwlock->lock);
+  rwlock->readers++;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->readers > 0);
+  if (--rwlock->readers == 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or writer
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rwlock->lock);
+  rwlock->waiting_writers++;
+  while (rwlock->writer || rwlock->readers > 0)
+    cond_wait (&rwlock->can_write, &rwlock->lock);
+  rwlock->waiting_writers--;
+  rwlock->writer = true;
+  lock_release (&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread holds for writing.
+   Waiting writers go first, then all waiting readers. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  lock_acquire (&rwlock->lock);
+  ASSERT (rwlock->writer);
+  rwlock->writer = false;
+  if (rwlock->waiting_writers > 0)
+    cond_signal (&rwlock->can_write, &rwlock->lock);
+  else
+    cond_broadcast (&rwlock->can_read, &rwlock->lock);
+  lock_release (&rwlock->lock);
+}
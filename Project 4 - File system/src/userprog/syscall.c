@@ -18,6 +18,7 @@
 static void syscall_handler (struct intr_frame *);
 static int get_free_fd(struct thread *curr);
 static int validate_addr(const uint8_t *addr);
+static void validate_buffer(const uint8_t *buf, unsigned size);
 void exit_process(int status);
 
 void
@@ -115,9 +116,7 @@ syscall_handler (struct intr_frame *f UNUSED)
         else if (!file->isFile)
           f->eax = 0;
         else{
-          acquire_filesys();
           f->eax = file_length(file->file);
-          release_filesys();
         }
       }
       else
@@ -143,9 +142,7 @@ syscall_handler (struct intr_frame *f UNUSED)
         else if(!file->isFile)
           f->eax = 0;
         else{
-          acquire_filesys();
           f->eax = file_read(file->file, sys_stack[2], sys_stack[3]);
-          release_filesys();
         }
       }
       else
@@ -169,9 +166,7 @@ syscall_handler (struct intr_frame *f UNUSED)
         else if(!file->isFile)
           f->eax = -1;
         else{
-          acquire_filesys();
           f->eax = file_write(file->file, buf, size);
-          release_filesys();
         }
       }
       else
@@ -183,11 +178,8 @@ syscall_handler (struct intr_frame *f UNUSED)
       validate_addr((uint8_t *) (sys_stack+2));
       if (2 <= sys_stack[1] && sys_stack[1] < 128){
         file = thread_current()->open_files[sys_stack[1]];
-        if (file != NULL && file->isFile){
-          acquire_filesys();
+        if (file != NULL && file->isFile)
           file_seek(file->file, sys_stack[2]);
-          release_filesys();
-        }
       }
       break;
 
@@ -200,9 +192,7 @@ syscall_handler (struct intr_frame *f UNUSED)
         else if (!file->isFile)
           f->eax = -1;
         else{
-          acquire_filesys();
           f->eax = file_tell(file->file);
-          release_filesys();
         }
       }
       else
@@ -288,6 +278,21 @@ syscall_handler (struct intr_frame *f UNUSED)
         f->eax = -1;
       break;
 
+    case SYS_READDIR_BULK:
+      validate_addr((uint8_t *) (sys_stack+3));
+      validate_buffer((uint8_t *) sys_stack[2], sys_stack[3]);
+      if (2 <= sys_stack[1] && sys_stack[1] < 128){
+        file = thread_current()->open_files[sys_stack[1]];
+        if (file == NULL || file->isFile)
+          f->eax = -1;
+        else
+          f->eax = dir_readdir_bulk(file->dir, (struct dir_record *) sys_stack[2],
+                                    (unsigned) sys_stack[3] / sizeof (struct dir_record));
+      }
+      else
+        f->eax = -1;
+      break;
+
     default:
       return;
   }
@@ -317,6 +322,20 @@ static int validate_addr(const uint8_t *addr)
   return 0;
 }
 
+/* Checks every page of the SIZE bytes at BUF. */
+static void validate_buffer(const uint8_t *buf, unsigned size)
+{
+  const uint8_t *last = buf + size - 1;
+  const uint8_t *page;
+  if (size == 0)
+    return;
+  if (last < buf)
+    exit_process(-1);
+  validate_addr(buf);
+  for (page = pg_round_down(buf) + PGSIZE; page <= last; page += PGSIZE)
+    validate_addr(page);
+}
+
 void exit_process(int status)
 { 
   struct thread *curr = thread_current();